@@ -0,0 +1,26 @@
+#include "ContextPool.h"
+
+std::unique_ptr<z3::context> ContextPool::Acquire(bool& reused)
+{
+    {
+        std::scoped_lock lock(pool_mutex);
+        if (!contexts.empty())
+        {
+            auto ctx = std::move(contexts.back());
+            contexts.pop_back();
+            reused = true;
+            return ctx;
+        }
+    }
+    // created outside of the lock, creating a context takes a while
+    reused = false;
+    return std::make_unique<z3::context>();
+}
+
+void ContextPool::Release(std::unique_ptr<z3::context> ctx)
+{
+    if (!ctx)
+        return;
+    std::scoped_lock lock(pool_mutex);
+    contexts.push_back(std::move(ctx));
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <z3++.h>
+
+// Z3 contexts reused by the jobs. Every worker takes one context for all the
+// jobs it runs and the simplifier returns it once the results of the jobs are
+// no longer needed. A pool can be shared by several simplifiers, so that a
+// program simplifying many small formulas creates only a few contexts.
+class ContextPool
+{
+public:
+    // `reused` is set to whether the context comes from an earlier run
+    std::unique_ptr<z3::context> Acquire(bool& reused);
+
+    // all terms of the context have to be released by then
+    void Release(std::unique_ptr<z3::context> ctx);
+
+private:
+    std::mutex pool_mutex;
+    std::vector<std::unique_ptr<z3::context>> contexts;
+};
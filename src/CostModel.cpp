@@ -0,0 +1,164 @@
+#include <set>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_set>
+#include <unordered_map>
+
+#include "CostModel.h"
+
+static unsigned SortBits(const z3::sort& s)
+{
+    if (s.is_bv())
+        return s.bv_size();
+    return 1;
+}
+
+CostFeatures ComputeCostFeatures(const z3::expr& root)
+{
+    CostFeatures f;
+    std::unordered_set<unsigned> visited;
+    std::set<std::string> vars;
+
+    std::vector<z3::expr> todo = {root};
+    while (!todo.empty())
+    {
+        z3::expr e = todo.back();
+        todo.pop_back();
+        if (!visited.insert(Z3_get_ast_id(e.ctx(), e)).second)
+            continue;
+        f.nodes++;
+
+        if (e.is_quantifier())
+        {
+            unsigned n = Z3_get_quantifier_num_bound(e.ctx(), e);
+            for (unsigned i = 0; i < n; ++i)
+            {
+                z3::sort s(e.ctx(), Z3_get_quantifier_bound_sort(e.ctx(), e, i));
+                f.vars++;
+                f.var_bits += SortBits(s);
+            }
+            todo.push_back(e.body());
+            continue;
+        }
+        if (e.is_var())
+            continue;
+
+        if (!e.is_bool())
+            f.max_width = std::max(f.max_width, SortBits(e.get_sort()));
+
+        if (e.is_const() && !e.is_numeral())
+        {
+            // free variables, bound ones are counted at their quantifier
+            if (vars.insert(e.decl().name().str()).second)
+            {
+                f.vars++;
+                f.var_bits += SortBits(e.get_sort());
+            }
+            continue;
+        }
+
+        if (e.is_app())
+        {
+            double w = SortBits(e.get_sort());
+            switch (e.decl().decl_kind())
+            {
+            case Z3_OP_BMUL:
+            {
+                bool by_const = false;
+                for (unsigned i = 0; i < e.num_args(); ++i)
+                    by_const |= e.arg(i).is_numeral();
+                f.nonlinear += by_const ? w : w * w;
+                break;
+            }
+            case Z3_OP_BUDIV:
+            case Z3_OP_BUDIV_I:
+            case Z3_OP_BSDIV:
+            case Z3_OP_BSDIV_I:
+            case Z3_OP_BUREM:
+            case Z3_OP_BUREM_I:
+            case Z3_OP_BSREM:
+            case Z3_OP_BSREM_I:
+            case Z3_OP_BSMOD:
+            case Z3_OP_BSMOD_I:
+                f.nonlinear += 2 * w * w;
+                break;
+            default:
+                break;
+            }
+            for (unsigned i = 0; i < e.num_args(); ++i)
+                todo.push_back(e.arg(i));
+        }
+    }
+    return f;
+}
+
+double PredictJobSeconds(const CostFeatures& f)
+{
+    // the BDDs of linear terms grow with the number of variable bits, the
+    // ones of multiplications and divisions with the square of their width
+    double linear = f.nodes * (1.0 + f.var_bits / 16.0);
+    return 2e-5 * linear + 5e-4 * f.nonlinear;
+}
+
+// kind: 0 outside of quantifiers, 1 forall, 2 exists
+static unsigned Alternations(const z3::expr& e, int kind, bool negated, std::unordered_map<unsigned long long, unsigned>& memo, std::unordered_set<unsigned>& quantifiers)
+{
+    if (!e.is_bool() || e.is_const())
+        return 0;
+
+    unsigned long long key = (unsigned long long)Z3_get_ast_id(e.ctx(), e) * 6 + kind * 2 + negated;
+    auto it = memo.find(key);
+    if (it != memo.end())
+        return it->second;
+
+    unsigned res = 0;
+    if (e.is_quantifier())
+    {
+        quantifiers.insert(Z3_get_ast_id(e.ctx(), e));
+        int q = (e.is_forall() != negated) ? 1 : 2;
+        res = (kind != 0 && kind != q) + Alternations(e.body(), q, negated, memo, quantifiers);
+    }
+    else if (e.is_app())
+    {
+        auto decl_kind = e.decl().decl_kind();
+        for (unsigned i = 0; i < e.num_args(); ++i)
+        {
+            // both polarities under iff, xor and the ite condition
+            bool flip = decl_kind == Z3_OP_NOT || (decl_kind == Z3_OP_IMPLIES && i == 0);
+            bool both = decl_kind == Z3_OP_IFF || decl_kind == Z3_OP_XOR || decl_kind == Z3_OP_EQ || (decl_kind == Z3_OP_ITE && i == 0);
+            res = std::max(res, Alternations(e.arg(i), kind, negated != flip, memo, quantifiers));
+            if (both)
+                res = std::max(res, Alternations(e.arg(i), kind, !negated, memo, quantifiers));
+        }
+    }
+    memo.emplace(key, res);
+    return res;
+}
+
+TriageFeatures ComputeTriageFeatures(const z3::expr& e)
+{
+    TriageFeatures f;
+    f.cost = ComputeCostFeatures(e);
+    std::unordered_map<unsigned long long, unsigned> memo;
+    std::unordered_set<unsigned> quantifiers;
+    f.alternations = Alternations(e, 0, false, memo, quantifiers);
+    f.quantifiers = quantifiers.size();
+    return f;
+}
+
+bool TriagePredictsGain(const TriageFeatures& f, int informative_probes, int probes)
+{
+    // nothing to approximate
+    if (f.quantifiers == 0)
+        return false;
+    // the approximations of the top quantifiers say nothing even at low
+    // widths, the deeper rounds rarely do better on such formulas
+    if (probes > 0 && informative_probes == 0)
+        return false;
+    // large formulas dominated by wide multiplications and divisions, where
+    // the BDDs blow up before the widths get useful
+    if (f.cost.max_width >= 64 && f.cost.nonlinear > 1e6 && informative_probes < probes)
+        return false;
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <z3++.h>
+
+// Features of a quantified subformula that drive the cost of its BDDs.
+struct CostFeatures
+{
+    // distinct subterms
+    unsigned nodes = 0;
+    // free and bound variables and their total bit-width
+    unsigned vars = 0;
+    unsigned var_bits = 0;
+    unsigned max_width = 0;
+    // multiplications and divisions weighted by the square of their width,
+    // multiplications by a constant only by the width
+    double nonlinear = 0;
+};
+
+CostFeatures ComputeCostFeatures(const z3::expr& e);
+
+// Rough estimate of the CPU seconds one approximation job of a subformula
+// with these features needs to get through its useful rounds. The weights
+// are hand-fitted; the predictions are logged next to the actual CPU time
+// of the jobs, so they can be recalibrated.
+double PredictJobSeconds(const CostFeatures& f);
+
+// Features for deciding whether to run FBS at all, from one linear pass.
+struct TriageFeatures
+{
+    CostFeatures cost;
+    // distinct quantified subformulas
+    unsigned quantifiers = 0;
+    // most quantifier kind changes on one path, counting negations
+    unsigned alternations = 0;
+};
+
+TriageFeatures ComputeTriageFeatures(const z3::expr& e);
+
+// Whether FBS is expected to help, given the features and how many of the
+// low-width probes of the top quantifiers gave a non-trivial approximation.
+// The thresholds were chosen by hand, the decisions are logged together
+// with the features, so they can be recalibrated on the benchmark results.
+bool TriagePredictsGain(const TriageFeatures& f, int informative_probes, int probes);
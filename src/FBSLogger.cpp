@@ -1,13 +1,12 @@
 #include <thread>
+#include <fstream>
 #include <iostream>
 
 #include "FBSLogger.h"
 
-FBSLogger logger;
-
 void FBSLogger::Log(const std::string& str)
 {
-    std::scoped_lock(output_mutex);
+    std::scoped_lock lock(output_mutex);
     LogSafe(str);
 }
 
@@ -21,7 +20,7 @@ void FBSLogger::LogSafe(const std::string& str)
 
 void FBSLogger::DumpBDD(const BDD& bdd)
 {
-    std::scoped_lock(output_mutex);
+    std::scoped_lock lock(output_mutex);
     auto filename = "bdd" + std::to_string(next_dot_id) + ".dot";
     auto file = fopen(filename.c_str(), "w");
     next_dot_id++;
@@ -33,7 +32,7 @@ void FBSLogger::DumpBDD(const BDD& bdd)
 
 void FBSLogger::DumpFormula(const std::string& filename, const z3::expr& expr)
 {
-    std::scoped_lock(output_mutex);
+    std::scoped_lock lock(output_mutex);
     Z3_set_ast_print_mode(expr.ctx(), Z3_PRINT_SMTLIB2_COMPLIANT);  
     std::string smt2_repr = Z3_benchmark_to_smtlib_string(expr.ctx(), "", "BV", "unknown", "", 0, NULL, expr);
 
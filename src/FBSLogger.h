@@ -49,5 +49,3 @@ private:
 
     void LogSafe(const std::string& str);
 };
-
-extern FBSLogger logger;
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <fstream>
+#include <sstream>
+#include <sys/resource.h>
+
+#include "FBSStats.h"
+#include "FBSTracer.h"
+
+long PeakRSSKb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+double ThreadCPUSeconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+template<typename T>
+static std::string JsonArray(const std::vector<T>& values)
+{
+    std::ostringstream ss;
+    ss << "[";
+    for (std::size_t i = 0; i < values.size(); ++i)
+        ss << (i > 0 ? "," : "") << values[i];
+    ss << "]";
+    return ss.str();
+}
+
+void FBSStats::MarkPhase(const std::string& name)
+{
+    std::scoped_lock lock(stats_mutex);
+    auto now = clck::now();
+    long peak = PeakRSSKb();
+    run.phases.push_back(PhaseStats{name, std::chrono::duration<double>(now - last_phase_tp).count(), peak, peak - last_peak_rss_kb});
+    last_phase_tp = now;
+    last_peak_rss_kb = peak;
+}
+
+void FBSStats::AddPhase(const std::string& name, double seconds)
+{
+    std::scoped_lock lock(stats_mutex);
+    // the growth of the peak is counted in the surrounding phase
+    run.phases.push_back(PhaseStats{name, seconds, PeakRSSKb(), 0});
+    last_phase_tp += std::chrono::duration_cast<clck::duration>(std::chrono::duration<double>(seconds));
+}
+
+void FBSStats::AddJob(const JobStats& job)
+{
+    std::scoped_lock lock(stats_mutex);
+    run.jobs.push_back(job);
+}
+
+void FBSStats::AddContext(bool reused, double ms)
+{
+    std::scoped_lock lock(stats_mutex);
+    if (reused)
+    {
+        run.contexts_reused++;
+    }
+    else
+    {
+        run.contexts_created++;
+        run.context_create_ms += ms;
+    }
+}
+
+void FBSStats::SetHandoff(double saved_seconds)
+{
+    std::scoped_lock lock(stats_mutex);
+    run.handoff_saved_seconds = saved_seconds;
+}
+
+void FBSStats::SetTriageSkipped()
+{
+    std::scoped_lock lock(stats_mutex);
+    run.triage_skipped = true;
+}
+
+void FBSStats::Merge(const RunStats& other)
+{
+    std::scoped_lock lock(stats_mutex);
+    run.phases.insert(run.phases.end(), other.phases.begin(), other.phases.end());
+    run.jobs.insert(run.jobs.end(), other.jobs.begin(), other.jobs.end());
+    run.contexts_created += other.contexts_created;
+    run.contexts_reused += other.contexts_reused;
+    run.context_create_ms += other.context_create_ms;
+    run.handoff_saved_seconds += other.handoff_saved_seconds;
+    run.triage_skipped |= other.triage_skipped;
+    last_phase_tp = clck::now();
+    last_peak_rss_kb = PeakRSSKb();
+}
+
+RunStats FBSStats::GetRunStats()
+{
+    std::scoped_lock lock(stats_mutex);
+    return run;
+}
+
+void FBSStats::Write()
+{
+    if (!enabled)
+        return;
+    std::scoped_lock lock(stats_mutex);
+
+    std::ostringstream ss;
+    ss << "{\"input\":" << JsonString(input)
+       << ",\"wall_seconds\":" << std::chrono::duration<double>(clck::now() - start_tp).count()
+       << ",\"peak_rss_kb\":" << PeakRSSKb()
+       << ",\"contexts_created\":" << run.contexts_created
+       << ",\"contexts_reused\":" << run.contexts_reused
+       << ",\"context_create_ms\":" << run.context_create_ms
+       << ",\"handoff_saved_seconds\":" << run.handoff_saved_seconds
+       << ",\"triage_skipped\":" << (run.triage_skipped ? "true" : "false");
+
+    ss << ",\"phases\":[";
+    for (std::size_t i = 0; i < run.phases.size(); ++i)
+    {
+        const auto& p = run.phases[i];
+        ss << (i > 0 ? "," : "") << "{\"name\":" << JsonString(p.name) << ",\"seconds\":" << p.seconds << ",\"process_peak_rss_kb\":" << p.process_peak_rss_kb
+           << ",\"peak_rss_growth_kb\":" << p.peak_rss_growth_kb << "}";
+    }
+    ss << "]";
+
+    ss << ",\"jobs\":[";
+    for (std::size_t i = 0; i < run.jobs.size(); ++i)
+    {
+        const auto& j = run.jobs[i];
+        ss << (i > 0 ? "," : "") << "{\"name\":" << JsonString(j.name)
+           << ",\"finished\":" << (j.finished ? "true" : "false")
+           << ",\"rounds\":" << j.rounds
+           << ",\"final_bw\":" << j.final_bw
+           << ",\"final_prec\":" << j.final_prec
+           << ",\"node_counts\":" << JsonArray(j.node_counts)
+           << ",\"approx_sizes\":" << JsonArray(j.approx_sizes)
+           << ",\"minimized\":" << j.minimized
+           << ",\"dropped\":" << j.dropped
+           << ",\"peak_live_nodes\":" << j.peak_live_nodes
+           << ",\"gc_ms\":" << j.gc_ms
+           << ",\"reorder_ms\":" << j.reorder_ms
+           << ",\"cache_hit_rate\":" << j.cache_hit_rate
+           << ",\"cpu_seconds\":" << j.cpu_seconds
+           << ",\"predicted_seconds\":" << j.predicted_seconds
+           << ",\"setup_ms\":" << j.setup_ms
+           << ",\"summaries\":" << j.summaries
+           << ",\"reset_ms\":" << j.reset_ms << "}";
+    }
+    ss << "]}";
+
+    std::ofstream of(output, std::ios::app);
+    of << ss.str() << std::endl;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+#include <chrono>
+
+struct JobStats
+{
+    std::string name;
+    bool finished = false;
+    int rounds = 0;
+    int final_bw = 0;
+    int final_prec = 0;
+    std::vector<int> node_counts;
+    std::vector<unsigned> approx_sizes;
+    int minimized = 0;
+    int dropped = 0;
+
+    long peak_live_nodes = 0;
+    long gc_ms = 0;
+    long reorder_ms = 0;
+    double cache_hit_rate = 0;
+
+    double cpu_seconds = 0;
+    // CPU time predicted by the cost model, 0 if it was not used
+    double predicted_seconds = 0;
+    // building the subformula and the transformer, releasing them at the end
+    double setup_ms = 0;
+    double reset_ms = 0;
+    // inner quantifiers replaced by the approximations of their jobs
+    int summaries = 0;
+};
+
+struct PhaseStats
+{
+    std::string name;
+    double seconds;
+    // the peak RSS of the process is a high-water mark of the whole run,
+    // the growth is how much it rose during the phase
+    long process_peak_rss_kb;
+    long peak_rss_growth_kb;
+};
+
+// Statistics of one simplification, returned together with its result.
+struct RunStats
+{
+    std::vector<PhaseStats> phases;
+    std::vector<JobStats> jobs;
+    // contexts taken by the workers from the ContextPool
+    int contexts_created = 0;
+    int contexts_reused = 0;
+    double context_create_ms = 0;
+    // left of the job budget when the jobs were stopped for lack of progress
+    double handoff_saved_seconds = 0;
+    // the triage decided to leave the formula as it is
+    bool triage_skipped = false;
+};
+
+long PeakRSSKb();
+double ThreadCPUSeconds();
+
+// Per-input statistics written as one JSON line per input file, so that
+// FBS effort can be joined with the results CSVs of the benchmark runs.
+// Phases and jobs are always recorded, SetOutput only enables Write.
+class FBSStats
+{
+public:
+    using clck = std::chrono::steady_clock;
+
+    FBSStats() { start_tp = last_phase_tp = clck::now(); last_peak_rss_kb = PeakRSSKb(); }
+
+    void SetOutput(const std::string& filename) { output = filename; enabled = !filename.empty(); }
+    void SetInput(const std::string& filename) { input = filename; }
+    bool IsEnabled() const { return enabled; }
+
+    // closes the phase that started at the previous mark
+    void MarkPhase(const std::string& name);
+    // a phase interleaved with the current one, its time is not counted
+    // in the current phase
+    void AddPhase(const std::string& name, double seconds);
+    void AddJob(const JobStats& job);
+    void AddContext(bool reused, double ms);
+    void SetHandoff(double saved_seconds);
+    void SetTriageSkipped();
+
+    // appends the phases and jobs of a finished simplification, the next
+    // phase starts now
+    void Merge(const RunStats& other);
+
+    RunStats GetRunStats();
+
+    void Write();
+
+private:
+    std::mutex stats_mutex;
+    bool enabled = false;
+    std::string output;
+    std::string input;
+    clck::time_point start_tp;
+    clck::time_point last_phase_tp;
+    long last_peak_rss_kb = 0;
+
+    RunStats run;
+};
+
@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <fstream>
+
+#include "FBSTracer.h"
+
+thread_local FBSTracer* FBSTracer::current = nullptr;
+
+std::string JsonString(const std::string& str)
+{
+    std::string res = "\"";
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            res += '\\';
+            res += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            // JSON allows no raw control characters in strings
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)(unsigned char)c);
+            res += buf;
+        }
+        else
+        {
+            res += c;
+        }
+    }
+    return res + "\"";
+}
+
+static std::string JsonArgs(const FBSTracer::Args& args)
+{
+    std::string res = "{";
+    for (std::size_t i = 0; i < args.size(); ++i)
+    {
+        if (i > 0)
+            res += ",";
+        res += JsonString(args[i].first) + ":" + args[i].second;
+    }
+    return res + "}";
+}
+
+void FBSTracer::AddSpan(const std::string& name, clck::time_point start, clck::time_point end, const Args& args)
+{
+    std::scoped_lock lock(events_mutex);
+    auto ts = std::chrono::duration_cast<std::chrono::microseconds>(start - start_tp).count();
+    auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    events.push_back(Event{name, ThreadIdSafe(), ts, dur, args});
+}
+
+void FBSTracer::SetThreadName(const std::string& name)
+{
+    if (!enabled)
+        return;
+    std::scoped_lock lock(events_mutex);
+    thread_names[ThreadIdSafe()] = name;
+}
+
+int FBSTracer::ThreadIdSafe()
+{
+    auto id = std::this_thread::get_id();
+    auto it = thread_ids.find(id);
+    if (it != thread_ids.end())
+        return it->second;
+    int tid = (int)thread_ids.size();
+    thread_ids.emplace(id, tid);
+    if (tid == 0)
+        thread_names.emplace(tid, "main");
+    return tid;
+}
+
+void FBSTracer::Write()
+{
+    if (!enabled)
+        return;
+    std::scoped_lock lock(events_mutex);
+
+    std::ofstream of(output);
+    of << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto&[tid, name] : thread_names)
+    {
+        of << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+           << ",\"args\":{\"name\":" << JsonString(name) << "}}";
+        first = false;
+    }
+    for (const auto& e : events)
+    {
+        of << (first ? "" : ",\n") << "{\"name\":" << JsonString(e.name) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+           << ",\"ts\":" << e.ts << ",\"dur\":" << e.dur << ",\"args\":" << JsonArgs(e.args) << "}";
+        first = false;
+    }
+    of << "\n]}" << std::endl;
+}
+
+void TraceScope::AddArg(const std::string& key, long long value)
+{
+    if (active)
+        args.emplace_back(key, std::to_string(value));
+}
+
+void TraceScope::AddArg(const std::string& key, const std::string& value)
+{
+    if (active)
+        args.emplace_back(key, JsonString(value));
+}
+
+void TraceScope::End()
+{
+    if (!active)
+        return;
+    active = false;
+    tracer->AddSpan(name, start_tp, FBSTracer::clck::now(), args);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+// Collects spans in the Chrome trace-event format (chrome://tracing, Perfetto)
+// and writes them as one JSON file at the end of the run. TraceScope records
+// into the tracer made current on its thread; simplifier jobs inherit the
+// tracer that was current when their FormulaSimplifier was created.
+class FBSTracer
+{
+public:
+    using clck = std::chrono::steady_clock;
+    using Args = std::vector<std::pair<std::string, std::string>>;
+
+    FBSTracer() { start_tp = clck::now(); }
+
+    void SetOutput(const std::string& filename) { output = filename; enabled = !filename.empty(); }
+    bool IsEnabled() const { return enabled; }
+
+    void AddSpan(const std::string& name, clck::time_point start, clck::time_point end, const Args& args);
+    void SetThreadName(const std::string& name);
+
+    void Write();
+
+    static FBSTracer* Current() { return current; }
+    static void SetCurrent(FBSTracer* t) { current = t; }
+
+private:
+    struct Event
+    {
+        std::string name;
+        int tid;
+        long long ts;
+        long long dur;
+        Args args;
+    };
+
+    std::mutex events_mutex;
+    bool enabled = false;
+    std::string output;
+    clck::time_point start_tp;
+
+    std::vector<Event> events;
+    std::map<std::thread::id, int> thread_ids;
+    std::map<int, std::string> thread_names;
+
+    static thread_local FBSTracer* current;
+
+    int ThreadIdSafe();
+};
+
+std::string JsonString(const std::string& str);
+
+class TraceScope
+{
+public:
+    TraceScope(const std::string& n) : name(n), tracer(FBSTracer::Current()), active(tracer && tracer->IsEnabled())
+    {
+        if (active)
+            start_tp = FBSTracer::clck::now();
+    }
+
+    ~TraceScope() { End(); }
+
+    void AddArg(const std::string& key, long long value);
+    void AddArg(const std::string& key, const std::string& value);
+
+    void End();
+
+private:
+    std::string name;
+    FBSTracer* tracer;
+    bool active;
+    FBSTracer::clck::time_point start_tp;
+    FBSTracer::Args args;
+};
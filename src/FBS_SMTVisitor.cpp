@@ -5,10 +5,14 @@
 
 #include "FBS_SMTVisitor.h"
 #include "FBSLogger.h"
+#include "FBSTracer.h"
+#include "FBSStats.h"
 
 #include "Logger.h"
 #include "Model.h"
 #include "FormulaSimplifier.h"
+#include "SimplifierBasic.h"
+#include "CostModel.h"
 
 const char* hex_char_to_bin(char c)
 {
@@ -52,6 +56,82 @@ Result FBS_SMTVisitor::Run(SMTLIBv2Parser::ScriptContext* script)
 }
 
 
+SimplifyResult FBS_SMTVisitor::Simplify(const z3::expr& e)
+{
+    auto components = settings.split_components ? splitComponents(e) : std::vector<z3::expr>{e};
+    if (components.size() > 1)
+        logger.Log(std::to_string(components.size()) + " independent components");
+
+    // the cheap components first, so that a false one ends the run early
+    std::vector<double> cost;
+    for (const auto& c : components)
+        cost.push_back(PredictJobSeconds(ComputeCostFeatures(c)));
+    std::vector<std::size_t> order(components.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) { return cost[a] < cost[b]; });
+    double cost_left = std::accumulate(cost.begin(), cost.end(), 0.0);
+
+    SimplifyResult res{ctx.bool_val(true), RunStats()};
+    res.verdict = SAT;
+    res.has_model = config.produceModels;
+    std::vector<z3::expr> out = components;
+    for (std::size_t n = 0; n < order.size(); ++n)
+    {
+        auto i = order[n];
+        Settings s = settings;
+        s.produce_models = config.produceModels;
+        // the share of the time left by the predicted cost, time the
+        // component does not use goes to the ones after it
+        int remaining = time_manager ? time_manager->RemainingMs() : 0;
+        if (remaining)
+            s.timeout_ms = cost_left > 0 ? std::max(1, (int)(remaining * cost[i] / cost_left)) : remaining / (int)(order.size() - n);
+        cost_left -= cost[i];
+        // every simplifier would overwrite out.smt2 with its component
+        if (components.size() > 1)
+            s.dump_files = false;
+
+        FormulaSimplifier fs(components[i], s, &contexts);
+        auto r = fs.Run();
+        if (stats)
+            stats->Merge(r.stats);
+        res.stats.handoff_saved_seconds += r.stats.handoff_saved_seconds;
+        out[i] = r.expr;
+        if (components.size() > 1 && settings.dump_files)
+            logger.DumpFormula("out_" + std::to_string(i) + ".smt2", r.expr);
+
+        if (r.verdict == UNSAT)
+        {
+            logger.Log("Component " + std::to_string(i) + " is false");
+            res.expr = ctx.bool_val(false);
+            res.verdict = UNSAT;
+            return res;
+        }
+        if (r.verdict != SAT)
+            res.verdict = NORESULT;
+        res.has_model &= r.has_model;
+        res.model.insert(r.model.begin(), r.model.end());
+    }
+
+    res.expr = simplifyAnd(ctx, out);
+    if (res.verdict != SAT || !res.has_model)
+    {
+        res.has_model = false;
+        res.model.clear();
+    }
+    return res;
+}
+
+z3::expr FBS_SMTVisitor::GetAssertions()
+{
+    z3::expr_vector ev(ctx);
+    for (const auto& assert : asserts)
+    {
+        for (const auto& x : assert)
+            ev.push_back(x);
+    }
+    return ev.size() == 1 ? ev[0] : z3::mk_and(ev);
+}
+
 void FBS_SMTVisitor::addConstant(const std::string& name, const z3::sort& s)
 {
     if (s.is_bool())
@@ -263,6 +343,7 @@ antlrcpp::Any FBS_SMTVisitor::visitCommand(SMTLIBv2Parser::CommandContext* comma
     {
         assert(!asserts.empty());
 
+        TraceScope trace("Assert");
         z3::expr formula = std::any_cast<z3::expr>(visitTerm(command->term(0)));
         asserts.back().push_back(formula);
     }
@@ -307,20 +388,37 @@ antlrcpp::Any FBS_SMTVisitor::visitCommand(SMTLIBv2Parser::CommandContext* comma
     }
     else if (command->cmd_checkSat())
     {
-        z3::expr_vector ev(ctx);
-        for(const auto& assert : asserts)
+        auto expr = GetAssertions();
+        if (stats)
+            stats->MarkPhase("BuildTerms");
+        if (settings.dump_files)
         {
-            for (const auto& x : assert)
-                ev.push_back(x);
+            logger.DumpFormula("in.smt2", expr);
+            logger.DumpFormula("out.smt2", expr);
         }
-        auto expr = ev.size() == 1 ? ev[0] : z3::mk_and(ev);
-        logger.DumpFormula("in.smt2", expr);
-        logger.DumpFormula("out.smt2", expr);
-        
-        FormulaSimplifier fs(expr);
-        auto new_expr = fs.Run();
 
-        logger.DumpFormula("out.smt2", new_expr);
+        auto res = Simplify(expr);
+        if (res.stats.handoff_saved_seconds > 0)
+            logger.Log("Early handoff, " + std::to_string(res.stats.handoff_saved_seconds) + " s of the time limit saved");
+
+        TraceScope trace("DumpOutput");
+        if (settings.dump_files)
+            logger.DumpFormula("out.smt2", res.expr);
+        if (stats)
+            stats->MarkPhase("DumpOutput");
+
+        // a constant result needs no second solver
+        result = res.verdict;
+        if (result == SAT)
+            std::cout << "sat" << std::endl;
+        else if (result == UNSAT)
+            std::cout << "unsat" << std::endl;
+        model = res.model;
+        hasModel = res.has_model;
+    }
+    else if ((command->cmd_getModel() || command->cmd_getValue()) && (!config.produceModels || result != SAT || !hasModel))
+    {
+        std::cout << "(error \"model is not available\")" << std::endl;
     }
     else if (command->cmd_getModel())
     {
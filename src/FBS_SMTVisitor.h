@@ -8,6 +8,12 @@
 
 #include "Solver.h"
 #include "Model.h"
+#include "Settings.h"
+#include "TimeoutManager.h"
+#include "FBSLogger.h"
+#include "FBSStats.h"
+#include "ContextPool.h"
+#include "FormulaSimplifier.h"
 
 #include "SMTLIBv2BaseVisitor.h"
 
@@ -29,10 +35,22 @@ public:
 
     Model GetModel() const { return model; }
 
+    z3::expr GetAssertions();
+
     void SetConfig(Config config)
     {
         this->config = config;
     }
+
+    // options of the simplification at check-sat; its timeout is what is
+    // left of the time limit of `tm`, stats are merged into `st` if given
+    void SetSettings(const Settings& s, const TimeoutManager& tm, FBSStats* st = nullptr)
+    {
+        settings = s;
+        time_manager = &tm;
+        stats = st;
+        logger.SetEnabled(s.verbose);
+    }
 private:
     z3::context ctx;
     std::map<std::string, z3::expr> constants;
@@ -42,6 +60,7 @@ private:
     std::map<std::string, z3::sort> sortDefinitions;
 
     void RunCommand(SMTLIBv2Parser::CommandContext*);
+    SimplifyResult Simplify(const z3::expr&);
 
     void addConstant(const std::string&, const z3::sort&);
     z3::expr addVar(const std::string&, const z3::sort&);
@@ -56,10 +75,18 @@ private:
     Result result = NORESULT;
 
     Config config;
+    Settings settings;
+    const TimeoutManager* time_manager = nullptr;
+    FBSStats* stats = nullptr;
+    FBSLogger logger;
+    // reused by the simplifiers of all check-sat commands
+    ContextPool contexts;
     std::vector<z3::expr_vector> asserts;
 
     bool exited = false;
     bool printSuccess = false;
 
     Model model;
+    // the model of the last sat result satisfies the assertions
+    bool hasModel = false;
 };
@@ -0,0 +1,323 @@
+#include <functional>
+#include <mutex>
+
+#include "FormulaIR.h"
+
+std::optional<FormulaIR::NodeId> FormulaIR::Add(const z3::expr& e)
+{
+    std::unique_lock lock(mutex);
+    // a failed Add may leave unreachable nodes behind, they are never built
+    return AddNode(e);
+}
+
+void FormulaIR::Clear()
+{
+    std::unique_lock lock(mutex);
+    nodes.clear();
+    children.clear();
+    strings.clear();
+    bound.clear();
+    added.clear();
+    unsupported.clear();
+    seen.clear();
+}
+
+void FormulaIR::ReleaseASTs()
+{
+    std::unique_lock lock(mutex);
+    added.clear();
+    unsupported.clear();
+    seen.clear();
+}
+
+// the operations BuildApp can rebuild
+static bool IsSupported(Z3_decl_kind op)
+{
+    static const std::unordered_set<int> supported = {
+        Z3_OP_TRUE, Z3_OP_FALSE, Z3_OP_EQ, Z3_OP_DISTINCT, Z3_OP_ITE, Z3_OP_AND, Z3_OP_OR, Z3_OP_IFF, Z3_OP_XOR, Z3_OP_NOT, Z3_OP_IMPLIES,
+        Z3_OP_BNEG, Z3_OP_BADD, Z3_OP_BSUB, Z3_OP_BMUL,
+        Z3_OP_BSDIV, Z3_OP_BUDIV, Z3_OP_BSREM, Z3_OP_BUREM, Z3_OP_BSMOD,
+        Z3_OP_BSDIV_I, Z3_OP_BUDIV_I, Z3_OP_BSREM_I, Z3_OP_BUREM_I, Z3_OP_BSMOD_I,
+        Z3_OP_ULEQ, Z3_OP_SLEQ, Z3_OP_UGEQ, Z3_OP_SGEQ, Z3_OP_ULT, Z3_OP_SLT, Z3_OP_UGT, Z3_OP_SGT,
+        Z3_OP_BAND, Z3_OP_BOR, Z3_OP_BNOT, Z3_OP_BXOR, Z3_OP_BNAND, Z3_OP_BNOR, Z3_OP_BXNOR,
+        Z3_OP_CONCAT, Z3_OP_SIGN_EXT, Z3_OP_ZERO_EXT, Z3_OP_EXTRACT, Z3_OP_REPEAT, Z3_OP_BREDOR, Z3_OP_BREDAND,
+        Z3_OP_BSHL, Z3_OP_BLSHR, Z3_OP_BASHR, Z3_OP_ROTATE_LEFT, Z3_OP_ROTATE_RIGHT, Z3_OP_EXT_ROTATE_LEFT, Z3_OP_EXT_ROTATE_RIGHT,
+    };
+    return supported.count(op) > 0;
+}
+
+std::optional<unsigned> FormulaIR::Width(const z3::sort& s) const
+{
+    if (s.is_bool())
+        return 0;
+    if (s.is_bv())
+        return s.bv_size();
+    return std::nullopt;
+}
+
+std::optional<FormulaIR::NodeId> FormulaIR::AddNode(const z3::expr& e)
+{
+    unsigned ast_id = Z3_get_ast_id(e.ctx(), e);
+    auto it = added.find(ast_id);
+    if (it != added.end())
+        return it->second;
+    if (unsupported.count(ast_id))
+        return std::nullopt;
+
+    auto res = AddSupported(e);
+    seen.push_back(e);
+    if (!res)
+        unsupported.insert(ast_id);
+    else
+        added.emplace(ast_id, *res);
+    return res;
+}
+
+std::optional<FormulaIR::NodeId> FormulaIR::AddSupported(const z3::expr& e)
+{
+
+    Node n{};
+    if (e.is_var())
+    {
+        auto width = Width(e.get_sort());
+        if (!width)
+            return std::nullopt;
+        n.kind = NodeKind::Var;
+        n.width = *width;
+        n.param[0] = (int)Z3_get_index_value(e.ctx(), e);
+    }
+    else if (e.is_quantifier())
+    {
+        if (e.is_lambda())
+            return std::nullopt;
+        auto body = AddNode(e.body());
+        if (!body)
+            return std::nullopt;
+
+        n.kind = e.is_forall() ? NodeKind::Forall : NodeKind::Exists;
+        n.width = 0;
+        n.first = (unsigned)bound.size();
+        n.count = Z3_get_quantifier_num_bound(e.ctx(), e);
+        n.param[0] = (int)*body;
+        n.param[1] = (int)Z3_get_quantifier_weight(e.ctx(), e);
+        for (unsigned i = 0; i < n.count; ++i)
+        {
+            z3::sort sort(e.ctx(), Z3_get_quantifier_bound_sort(e.ctx(), e, i));
+            auto width = Width(sort);
+            if (!width)
+                return std::nullopt;
+            z3::symbol name(e.ctx(), Z3_get_quantifier_bound_name(e.ctx(), e, i));
+            strings.push_back(name.kind() == Z3_STRING_SYMBOL ? name.str() : "x!" + std::to_string(name.to_int()));
+            bound.emplace_back((unsigned)strings.size() - 1, *width);
+        }
+    }
+    else if (e.is_numeral())
+    {
+        auto width = Width(e.get_sort());
+        if (!width || *width == 0)
+            return std::nullopt;
+        n.kind = NodeKind::Numeral;
+        n.width = *width;
+        n.first = (unsigned)strings.size();
+        strings.push_back(Z3_get_numeral_string(e.ctx(), e));
+    }
+    else if (e.is_app())
+    {
+        auto width = Width(e.get_sort());
+        if (!width)
+            return std::nullopt;
+        z3::func_decl f = e.decl();
+        n.width = *width;
+        n.op = f.decl_kind();
+
+        if (n.op == Z3_OP_UNINTERPRETED)
+        {
+            if (e.num_args() > 0 || f.name().kind() != Z3_STRING_SYMBOL)
+                return std::nullopt;
+            n.kind = NodeKind::Const;
+            n.first = (unsigned)strings.size();
+            strings.push_back(f.name().str());
+        }
+        else
+        {
+            n.kind = NodeKind::App;
+            if (!IsSupported(n.op))
+                return std::nullopt;
+            unsigned n_params = Z3_get_decl_num_parameters(e.ctx(), f);
+            if (n_params > 2)
+                return std::nullopt;
+            for (unsigned i = 0; i < n_params; ++i)
+            {
+                if (Z3_get_decl_parameter_kind(e.ctx(), f, i) != Z3_PARAMETER_INT)
+                    return std::nullopt;
+                n.param[i] = Z3_get_decl_int_parameter(e.ctx(), f, i);
+            }
+
+            std::vector<NodeId> args;
+            for (unsigned i = 0; i < e.num_args(); ++i)
+            {
+                auto arg = AddNode(e.arg(i));
+                if (!arg)
+                    return std::nullopt;
+                args.push_back(*arg);
+            }
+            n.first = (unsigned)children.size();
+            n.count = (unsigned)args.size();
+            children.insert(children.end(), args.begin(), args.end());
+        }
+    }
+    else
+    {
+        return std::nullopt;
+    }
+
+    nodes.push_back(n);
+    return (NodeId)nodes.size() - 1;
+}
+
+z3::sort FormulaIR::Sort(unsigned width, z3::context& ctx) const
+{
+    return width == 0 ? ctx.bool_sort() : ctx.bv_sort(width);
+}
+
+z3::expr FormulaIR::Build(NodeId root, z3::context& ctx, std::unordered_map<NodeId, z3::expr> replaced) const
+{
+    std::shared_lock lock(mutex);
+    return BuildNode(root, ctx, replaced);
+}
+
+z3::expr FormulaIR::BuildNode(NodeId id, z3::context& ctx, std::unordered_map<NodeId, z3::expr>& cache) const
+{
+    auto it = cache.find(id);
+    if (it != cache.end())
+        return it->second;
+
+    const Node& n = nodes[id];
+    z3::expr res(ctx);
+    switch (n.kind)
+    {
+        case NodeKind::Var:
+            res = z3::expr(ctx, Z3_mk_bound(ctx, n.param[0], Sort(n.width, ctx)));
+            break;
+        case NodeKind::Const:
+            res = ctx.constant(strings[n.first].c_str(), Sort(n.width, ctx));
+            break;
+        case NodeKind::Numeral:
+            res = ctx.bv_val(strings[n.first].c_str(), n.width);
+            break;
+        case NodeKind::Forall:
+        case NodeKind::Exists:
+        {
+            z3::expr body = BuildNode((NodeId)n.param[0], ctx, cache);
+            std::vector<Z3_sort> sorts;
+            std::vector<Z3_symbol> names;
+            for (unsigned i = 0; i < n.count; ++i)
+            {
+                const auto&[name, width] = bound[n.first + i];
+                sorts.push_back(Sort(width, ctx));
+                names.push_back(Z3_mk_string_symbol(ctx, strings[name].c_str()));
+            }
+            res = z3::expr(ctx, Z3_mk_quantifier(ctx, n.kind == NodeKind::Forall, n.param[1], 0, nullptr, n.count, sorts.data(), names.data(), body));
+            break;
+        }
+        case NodeKind::App:
+        {
+            std::vector<z3::expr> args;
+            for (unsigned i = 0; i < n.count; ++i)
+                args.push_back(BuildNode(children[n.first + i], ctx, cache));
+            res = BuildApp(n, ctx, args);
+            break;
+        }
+    }
+    ctx.check_error();
+
+    cache.emplace(id, res);
+    return res;
+}
+
+z3::expr FormulaIR::BuildApp(const Node& n, z3::context& ctx, const std::vector<z3::expr>& args) const
+{
+    // left fold for the operations that Z3 keeps n-ary
+    auto fold = [&](const std::function<z3::expr(const z3::expr&, const z3::expr&)>& op) {
+        z3::expr res = args[0];
+        for (std::size_t i = 1; i < args.size(); ++i)
+            res = op(res, args[i]);
+        return res;
+    };
+    z3::expr_vector vec(ctx);
+    for (const auto& a : args)
+        vec.push_back(a);
+
+    switch (n.op)
+    {
+        case Z3_OP_TRUE: return ctx.bool_val(true);
+        case Z3_OP_FALSE: return ctx.bool_val(false);
+        case Z3_OP_EQ:
+        case Z3_OP_IFF:
+        {
+            std::vector<z3::expr> eqs;
+            for (std::size_t i = 1; i < args.size(); ++i)
+                eqs.push_back(args[i - 1] == args[i]);
+            if (eqs.size() == 1)
+                return eqs[0];
+            z3::expr_vector conj(ctx);
+            for (const auto& eq : eqs)
+                conj.push_back(eq);
+            return z3::mk_and(conj);
+        }
+        case Z3_OP_DISTINCT: return z3::distinct(vec);
+        case Z3_OP_ITE: return z3::ite(args[0], args[1], args[2]);
+        case Z3_OP_AND: return z3::mk_and(vec);
+        case Z3_OP_OR: return z3::mk_or(vec);
+        case Z3_OP_XOR: return fold([](const z3::expr& a, const z3::expr& b) { return a ^ b; });
+        case Z3_OP_NOT: return !args[0];
+        case Z3_OP_IMPLIES: return z3::implies(args[0], args[1]);
+
+        case Z3_OP_BNEG: return -args[0];
+        case Z3_OP_BADD: return fold([](const z3::expr& a, const z3::expr& b) { return a + b; });
+        case Z3_OP_BSUB: return fold([](const z3::expr& a, const z3::expr& b) { return a - b; });
+        case Z3_OP_BMUL: return fold([](const z3::expr& a, const z3::expr& b) { return a * b; });
+        case Z3_OP_BSDIV: case Z3_OP_BSDIV_I: return args[0] / args[1];
+        case Z3_OP_BUDIV: case Z3_OP_BUDIV_I: return z3::udiv(args[0], args[1]);
+        case Z3_OP_BSREM: case Z3_OP_BSREM_I: return z3::srem(args[0], args[1]);
+        case Z3_OP_BUREM: case Z3_OP_BUREM_I: return z3::urem(args[0], args[1]);
+        case Z3_OP_BSMOD: case Z3_OP_BSMOD_I: return z3::smod(args[0], args[1]);
+
+        case Z3_OP_ULEQ: return z3::ule(args[0], args[1]);
+        case Z3_OP_SLEQ: return args[0] <= args[1];
+        case Z3_OP_UGEQ: return z3::uge(args[0], args[1]);
+        case Z3_OP_SGEQ: return args[0] >= args[1];
+        case Z3_OP_ULT: return z3::ult(args[0], args[1]);
+        case Z3_OP_SLT: return args[0] < args[1];
+        case Z3_OP_UGT: return z3::ugt(args[0], args[1]);
+        case Z3_OP_SGT: return args[0] > args[1];
+
+        case Z3_OP_BAND: return fold([](const z3::expr& a, const z3::expr& b) { return a & b; });
+        case Z3_OP_BOR: return fold([](const z3::expr& a, const z3::expr& b) { return a | b; });
+        case Z3_OP_BXOR: return fold([](const z3::expr& a, const z3::expr& b) { return a ^ b; });
+        case Z3_OP_BNOT: return ~args[0];
+        case Z3_OP_BNAND: return z3::nand(args[0], args[1]);
+        case Z3_OP_BNOR: return z3::nor(args[0], args[1]);
+        case Z3_OP_BXNOR: return z3::xnor(args[0], args[1]);
+
+        case Z3_OP_CONCAT: return fold([](const z3::expr& a, const z3::expr& b) { return z3::concat(a, b); });
+        case Z3_OP_SIGN_EXT: return z3::sext(args[0], n.param[0]);
+        case Z3_OP_ZERO_EXT: return z3::zext(args[0], n.param[0]);
+        case Z3_OP_EXTRACT: return args[0].extract(n.param[0], n.param[1]);
+        case Z3_OP_REPEAT: return z3::expr(ctx, Z3_mk_repeat(ctx, n.param[0], args[0]));
+        case Z3_OP_BREDOR: return z3::expr(ctx, Z3_mk_bvredor(ctx, args[0]));
+        case Z3_OP_BREDAND: return z3::expr(ctx, Z3_mk_bvredand(ctx, args[0]));
+
+        case Z3_OP_BSHL: return z3::shl(args[0], args[1]);
+        case Z3_OP_BLSHR: return z3::lshr(args[0], args[1]);
+        case Z3_OP_BASHR: return z3::ashr(args[0], args[1]);
+        case Z3_OP_ROTATE_LEFT: return z3::expr(ctx, Z3_mk_rotate_left(ctx, n.param[0], args[0]));
+        case Z3_OP_ROTATE_RIGHT: return z3::expr(ctx, Z3_mk_rotate_right(ctx, n.param[0], args[0]));
+        case Z3_OP_EXT_ROTATE_LEFT: return z3::expr(ctx, Z3_mk_ext_rotate_left(ctx, args[0], args[1]));
+        case Z3_OP_EXT_ROTATE_RIGHT: return z3::expr(ctx, Z3_mk_ext_rotate_right(ctx, args[0], args[1]));
+
+        default:
+            // Add only accepts the operations in IsSupported
+            throw z3::exception("unsupported operation in FormulaIR");
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <z3++.h>
+
+// Context-free copy of a formula DAG. The main thread adds every quantified
+// subformula once (shared subterms are stored once for all of them), and the
+// jobs rebuild their subformulas from it in their own contexts concurrently.
+// Nodes are never changed once added, so jobs may already build while the
+// main thread still adds the subformulas of later jobs.
+class FormulaIR
+{
+public:
+    using NodeId = uint32_t;
+
+    // returns the root of e, or nothing if e uses an operation the IR does
+    // not support (such formulas have to be translated directly)
+    std::optional<NodeId> Add(const z3::expr& e);
+
+    // the nodes in `replaced` are not built, the given terms are used instead
+    z3::expr Build(NodeId root, z3::context& ctx, std::unordered_map<NodeId, z3::expr> replaced = {}) const;
+
+    std::size_t NodeCount() const
+    {
+        std::shared_lock lock(mutex);
+        return nodes.size();
+    }
+
+    // drops the references to the Z3 ASTs added so far, so that their
+    // context may be released; later Adds no longer share nodes with them
+    void ReleaseASTs();
+
+    void Clear();
+
+private:
+    enum class NodeKind : uint8_t
+    {
+        App,
+        Var,
+        Const,
+        Numeral,
+        Forall,
+        Exists,
+    };
+
+    // App: op applied to `count` children starting at `first`, with up to
+    //      two integer parameters of the declaration
+    // Var: de Bruijn index in param[0]
+    // Const, Numeral: name or decimal value in strings[first]
+    // Forall, Exists: `count` bound variables starting at bound[first],
+    //      the body in param[0] and the weight in param[1]
+    struct Node
+    {
+        NodeKind kind;
+        Z3_decl_kind op;
+        // bit-width, 0 for Bool
+        unsigned width;
+        unsigned first;
+        unsigned count;
+        int param[2];
+    };
+
+    // Add is exclusive, any number of Builds may run at once
+    mutable std::shared_mutex mutex;
+
+    std::vector<Node> nodes;
+    std::vector<NodeId> children;
+    std::vector<std::string> strings;
+    // name and width of bound variables
+    std::vector<std::pair<unsigned, unsigned>> bound;
+
+    // ids of the Z3 ASTs already added or rejected, only used by Add; Z3
+    // reuses the ids of freed ASTs, so the ASTs are kept alive in `seen`
+    // for as long as their ids are cached
+    std::unordered_map<unsigned, NodeId> added;
+    std::unordered_set<unsigned> unsupported;
+    std::vector<z3::expr> seen;
+
+    std::optional<NodeId> AddNode(const z3::expr& e);
+    std::optional<NodeId> AddSupported(const z3::expr& e);
+    std::optional<unsigned> Width(const z3::sort& s) const;
+
+    z3::expr BuildNode(NodeId id, z3::context& ctx, std::unordered_map<NodeId, z3::expr>& cache) const;
+    z3::expr BuildApp(const Node& n, z3::context& ctx, const std::vector<z3::expr>& args) const;
+    z3::sort Sort(unsigned width, z3::context& ctx) const;
+};
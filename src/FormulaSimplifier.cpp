@@ -4,66 +4,850 @@
 #include <future>
 #include <algorithm>
 #include <cassert>
+#include <limits>
+#include <numeric>
+#include <set>
+#include <memory>
+#include <variant>
+#include <unordered_set>
 
 #include "FormulaSimplifier.h"
 #include "SimplifierThread.h"
 #include "SimplifierBasic.h"
 #include "FBSLogger.h"
+#include "FBSTracer.h"
+#include "FBSStats.h"
 #include "TimeoutManager.h"
 #include "Settings.h"
+#include "CostModel.h"
 
 #include "Config.h"
 #include "ExprToBDDTransformer.h"
 #include "ExprSimplifier.h"
-#include "Solver.h"
 
-z3::expr FormulaSimplifier::Run()
+// Whether every existential quantifier of e that is not below a universal
+// one occurs only under conjunctions and disjunctions. Q3B may then treat the
+// variables of these existentials like free ones when deciding e.
+static bool ExistentialsArePositive(z3::expr e)
 {
+    std::set<std::pair<unsigned, bool>> visited;
+    std::vector<std::pair<z3::expr, bool>> todo = {{e, true}};
+    while (!todo.empty())
+    {
+        auto [curr, positive] = todo.back();
+        todo.pop_back();
+        if (!visited.emplace(Z3_get_ast_id(curr.ctx(), curr), positive).second)
+            continue;
+
+        if (curr.is_quantifier())
+        {
+            // below a universal quantifier Q3B takes the general path
+            if (curr.is_forall())
+                continue;
+            if (!positive)
+                return false;
+            todo.emplace_back(curr.body(), true);
+        }
+        else if (curr.is_app())
+        {
+            auto kind = curr.decl().decl_kind();
+            bool keep = positive && (kind == Z3_OP_AND || kind == Z3_OP_OR);
+            for (unsigned i = 0; i < curr.num_args(); ++i)
+                todo.emplace_back(curr.arg(i), keep);
+        }
+    }
+    return true;
+}
+
+FormulaSimplifier::~FormulaSimplifier()
+{
+    stop = true;
+    JoinWorkers();
+    // the jobs hold terms of the worker contexts
+    speculative.clear();
+    threads.clear();
+    for (auto& ctx : worker_contexts)
+        contexts.Release(std::move(ctx));
+    for (auto& s : schedule)
+        contexts.Release(std::move(s.ctx));
+}
+
+SimplifyResult FormulaSimplifier::Run()
+{
+    if (settings.triage && !Triage())
+    {
+        stats.SetTriageSkipped();
+        return SimplifyResult{expr, stats.GetRunStats()};
+    }
+
+    z3::expr input = expr;
     auto out = RunSimplifications();
-    logger.DumpFormula("out.smt2", out);
+    if (settings.dump_files)
+    {
+        TraceScope trace("DumpResult");
+        logger.DumpFormula("out.smt2", out);
+        stats.MarkPhase("DumpResult");
+    }
+    JoinWorkers();
+    stats.MarkPhase("Join");
+    for (const auto& t : threads)
+    {
+        const auto& js = t.GetStats();
+        if (js.predicted_seconds > 0)
+            logger.Log("Job " + js.name + ": predicted " + std::to_string(js.predicted_seconds) + " s, actual " + std::to_string(js.cpu_seconds) + " s" + (js.finished ? "" : " (stopped)"));
+        stats.AddJob(js);
+    }
+    for (const auto& t : speculative)
+        stats.AddJob(t.GetStats());
+
+    SimplifyResult res{out, stats.GetRunStats()};
+    if (isFalse(out))
+    {
+        res.verdict = UNSAT;
+    }
+    else if (isTrue(out))
+    {
+        res.verdict = SAT;
+        if (settings.produce_models)
+        {
+            // without a model of the whole formula job, the simplified
+            // formula is equivalent to true and any assignment will do
+            res.model = ZeroModel(input);
+            if (model)
+            {
+                // with the existential fast path, the model of the job also
+                // assigns the variables of the outer existentials
+                for (const auto&[name, value] : *model)
+                {
+                    if (res.model.count(name))
+                        res.model[name] = value;
+                }
+            }
+            // the constants eliminated by the ExprSimplifier are only
+            // guessed, so a model that fails on the input is not reported
+            res.has_model = CheckModel(res.model, input);
+            if (!res.has_model)
+            {
+                logger.Log("The model does not satisfy the input");
+                res.model.clear();
+            }
+        }
+    }
+    return res;
+}
+
+// the uninterpreted constants of e
+static std::vector<z3::expr> FreeConstants(const z3::expr& e)
+{
+    std::vector<z3::expr> res;
+    std::unordered_set<unsigned> visited;
+    std::vector<z3::expr> todo = {e};
+    while (!todo.empty())
+    {
+        z3::expr curr = todo.back();
+        todo.pop_back();
+        if (!visited.insert(Z3_get_ast_id(curr.ctx(), curr)).second)
+            continue;
+
+        if (curr.is_quantifier())
+        {
+            todo.push_back(curr.body());
+        }
+        else if (curr.is_const() && !curr.is_numeral() && curr.decl().decl_kind() == Z3_OP_UNINTERPRETED)
+        {
+            res.push_back(curr);
+        }
+        else if (curr.is_app())
+        {
+            for (unsigned i = 0; i < curr.num_args(); ++i)
+                todo.push_back(curr.arg(i));
+        }
+    }
+    return res;
+}
+
+Model FormulaSimplifier::ZeroModel(const z3::expr& e) const
+{
+    Model res;
+    for (const auto& c : FreeConstants(e))
+    {
+        if (c.is_bool())
+            res[c.to_string()] = false;
+        else if (c.is_bv())
+            res[c.to_string()] = std::vector<bool>(c.get_sort().bv_size(), false);
+    }
+    return res;
+}
+
+bool FormulaSimplifier::CheckModel(const Model& m, const z3::expr& e) const
+{
+    TraceScope trace("CheckModel");
+    z3::context& ctx = e.ctx();
+    z3::model zm(ctx);
+    for (const auto& c : FreeConstants(e))
+    {
+        auto it = m.find(c.to_string());
+        if (it == m.end())
+            continue;
+        z3::expr value(ctx);
+        if (auto b = std::get_if<bool>(&it->second))
+        {
+            value = ctx.bool_val(*b);
+        }
+        else
+        {
+            // least significant bit first, like Z3_mk_bv_numeral
+            const auto& bits = std::get<std::vector<bool>>(it->second);
+            std::unique_ptr<bool[]> arr(new bool[bits.size()]);
+            std::copy(bits.begin(), bits.end(), arr.get());
+            value = ctx.bv_val((unsigned)bits.size(), arr.get());
+        }
+        z3::func_decl decl = c.decl();
+        zm.add_const_interp(decl, value);
+    }
+
+    z3::expr value = zm.eval(e, true);
+    if (value.is_true())
+        return true;
+    if (value.is_false())
+        return false;
+
+    // the evaluator keeps the quantifiers, their free constants are all
+    // assigned by now, so the rest is a closed formula
+    z3::solver s(ctx);
+    if (int remaining = time_manager.RemainingMs())
+        s.set("timeout", (unsigned)remaining);
+    s.add(!value);
+    return s.check() == z3::unsat;
+}
+
+bool FormulaSimplifier::Triage()
+{
+    TraceScope trace("Triage");
+    auto features = ComputeTriageFeatures(expr);
+
+    // one low-width round of each of the first few top-level quantifiers,
+    // in parallel and cut off after a few milliseconds
+    std::vector<z3::expr> top;
+    std::vector<z3::expr> todo = {expr};
+    while (!todo.empty() && top.size() < 4)
+    {
+        z3::expr e = todo.back();
+        todo.pop_back();
+        if (e.is_quantifier())
+            top.push_back(e);
+        else if (e.is_app() && e.is_bool())
+            for (unsigned i = 0; i < e.num_args(); ++i)
+                todo.push_back(e.arg(i));
+    }
+
+    std::atomic<bool> probe_stop = false;
+    TimeoutManager probe_budget;
+    probe_budget.SetTimeoutMs(settings.triage_probe_ms);
+    SimplifierEnv probe_env{settings, logger, probe_stop, probe_budget, env.tracer, expr.ctx()};
+    std::list<SimplifierThread> probes;
+    for (const auto& q : top)
+        probes.emplace_back(probe_env, q, settings.use_over, std::vector<z3::expr>());
+
+    std::vector<std::thread> probe_threads;
+    for (auto& p : probes)
+    {
+        probe_threads.emplace_back([&p, this] {
+            FBSTracer::SetCurrent(env.tracer);
+            // directly translated jobs run in their own context
+            if (p.Start(expr.ctx()))
+                p.Step();
+            p.Finish();
+        });
+    }
+    while (!probe_budget.IsTimeout() && !std::all_of(probes.begin(), probes.end(), [](const auto& p) { return p.IsFinished(); }))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    probe_stop = true;
+    for (auto& t : probe_threads)
+        t.join();
+
+    int informative = std::count_if(probes.begin(), probes.end(), [](const auto& p) { return p.HasResult(); });
+    bool gain = TriagePredictsGain(features, informative, probes.size());
+    logger.Log("Triage: " + std::to_string(features.quantifiers) + " quantifiers, " + std::to_string(features.alternations) + " alternations, "
+        + std::to_string(features.cost.nodes) + " nodes, max width " + std::to_string(features.cost.max_width) + ", nonlinear " + std::to_string(features.cost.nonlinear)
+        + ", " + std::to_string(informative) + "/" + std::to_string(probes.size()) + " probes informative -> " + (gain ? "simplify" : "skip"));
+    trace.AddArg("skip", (long long)!gain);
+    stats.MarkPhase("Triage");
+    return gain;
+}
+
+void FormulaSimplifier::AddJob(z3::expr e, bool over, const std::vector<z3::expr>& bound)
+{
+    // subterms shared by nested quantifiers are added to the IR only once,
+    // the jobs then build their own copies in parallel
+    auto root = ir.Add(e);
+    std::vector<FormulaIR::NodeId> bound_ids;
+    for (const auto& b : bound)
+    {
+        auto id = ir.Add(b);
+        if (!id)
+            break;
+        bound_ids.push_back(*id);
+    }
+
+    if (root && bound_ids.size() == bound.size())
+        threads.emplace_back(env, ir, *root, over, bound_ids);
+    else
+        threads.emplace_back(env, e, over, bound);
+
+    auto it = selected.find(Z3_get_ast_id(e.ctx(), e));
+    if (it != selected.end())
+        threads.back().SetPrediction(it->second);
+    if (over && bound.empty() && top_conjuncts.count(Z3_get_ast_id(e.ctx(), e)))
+        refuters.push_back(&threads.back());
+
+    // jobs are added inner ones first
+    if (settings.summaries)
+        LinkSummaries(threads.back(), e.is_quantifier() ? e.body() : e, over);
+    if (e.is_quantifier())
+    {
+        auto& jobs = quant_jobs[Z3_get_ast_id(e.ctx(), e)];
+        (over ? jobs.over : jobs.under) = &threads.back();
+    }
+}
+
+void FormulaSimplifier::LinkSummaries(SimplifierThread& job, const z3::expr& e, bool over)
+{
+    // polarity of the outermost quantifiers with jobs in e: 1 positive, -1
+    // negative, 0 both or below an operator that is not monotone
+    std::unordered_map<unsigned, int> polarity;
+    std::set<std::pair<unsigned, int>> visited;
+    std::vector<std::pair<z3::expr, int>> todo = {{e, 1}};
+    while (!todo.empty())
+    {
+        auto [curr, pol] = todo.back();
+        todo.pop_back();
+        unsigned id = Z3_get_ast_id(curr.ctx(), curr);
+        if (!visited.emplace(id, pol).second)
+            continue;
+
+        if (curr.is_quantifier())
+        {
+            if (!quant_jobs.count(id))
+            {
+                todo.emplace_back(curr.body(), pol);
+                continue;
+            }
+            auto [it, inserted] = polarity.emplace(id, pol);
+            if (!inserted && it->second != pol)
+                it->second = 0;
+        }
+        else if (curr.is_app())
+        {
+            auto kind = curr.decl().decl_kind();
+            for (unsigned i = 0; i < curr.num_args(); ++i)
+            {
+                int arg_pol = 0;
+                if (kind == Z3_OP_AND || kind == Z3_OP_OR)
+                    arg_pol = pol;
+                else if (kind == Z3_OP_NOT)
+                    arg_pol = -pol;
+                else if (kind == Z3_OP_IMPLIES)
+                    arg_pol = i == 0 ? -pol : pol;
+                todo.emplace_back(curr.arg(i), arg_pol);
+            }
+        }
+    }
+
+    // the formula only grows (shrinks) if its positive occurrences grow
+    // (shrink) and its negative ones shrink (grow)
+    for (const auto&[id, pol] : polarity)
+    {
+        if (pol == 0)
+            continue;
+        const auto& jobs = quant_jobs.at(id);
+        auto* inner = (pol > 0) == over ? jobs.over : jobs.under;
+        if (inner)
+            job.AddSummarySource(inner);
+    }
+}
+
+bool FormulaSimplifier::HasJob(const z3::expr& q, int depth) const
+{
+    if (settings.selection == Selection::COST)
+        return selected.count(Z3_get_ast_id(q.ctx(), q)) > 0;
+    return depth > 0;
+}
+
+void FormulaSimplifier::CollectQuantifiers(z3::expr e, int depth, std::vector<z3::expr>& res)
+{
+    if (e.is_const() || !e.is_bool() || (settings.max_depth && depth >= settings.max_depth))
+        return;
+
+    if (e.is_app())
+    {
+        for (unsigned i = 0; i < e.num_args(); ++i)
+            CollectQuantifiers(e.arg(i), depth, res);
+    }
+
+    if (e.is_quantifier())
+    {
+        res.push_back(e);
+        CollectQuantifiers(e.body(), depth + 1, res);
+    }
+}
+
+void FormulaSimplifier::SelectByCost(z3::expr e)
+{
+    // every occurrence of a quantifier gets its own jobs
+    std::vector<z3::expr> occurrences;
+    CollectQuantifiers(e, 0, occurrences);
+    std::unordered_map<unsigned, std::pair<z3::expr, int>> quants;
+    for (const auto& q : occurrences)
+    {
+        auto [it, inserted] = quants.try_emplace(Z3_get_ast_id(q.ctx(), q), q, 0);
+        it->second.second++;
+    }
+
+    int jobs_per_quant = (int)settings.use_over + (int)settings.use_under;
+    struct Candidate { unsigned id; int count; double predicted; double cost; };
+    std::vector<Candidate> candidates;
+    for (const auto& [id, q] : quants)
+    {
+        double predicted = PredictJobSeconds(ComputeCostFeatures(q.first));
+        candidates.push_back(Candidate{id, q.second, predicted, predicted * q.second * jobs_per_quant});
+    }
+    // cheapest first, the most quantifiers that fit get approximated
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.cost < b.cost || (a.cost == b.cost && a.id < b.id); });
+
+    // CPU seconds of all cores until the timeout
+    int cores = settings.max_threads > 0 ? settings.max_threads : std::max(1u, std::thread::hardware_concurrency());
+    int remaining_ms = jobs_budget.RemainingMs();
+    double budget = remaining_ms ? cores * remaining_ms / 1000.0 : std::numeric_limits<double>::infinity();
+
+    double total = 0;
+    int count = 0;
+    for (const auto& c : candidates)
+    {
+        if (settings.max_quants && count + c.count > settings.max_quants)
+            break;
+        // the cheapest quantifier is approximated even if over the budget,
+        // its first rounds are still useful
+        if (total + c.cost > budget && !selected.empty())
+            break;
+        selected.emplace(c.id, c.predicted);
+        total += c.cost;
+        count += c.count;
+    }
+
+    logger.Log("Cost model selected " + std::to_string(count) + "/" + std::to_string(occurrences.size()) + " quantifiers, predicted "
+        + std::to_string(total) + " s of " + (remaining_ms ? std::to_string(budget) + " s" : "unlimited") + " CPU time on " + std::to_string(cores) + " cores");
+}
+
+void FormulaSimplifier::Publish(SimplifierThread& job)
+{
+    // Schedule::ROUNDS picks the rounds among all jobs, so it starts once
+    // they are all added
+    if (settings.schedule != Schedule::JOBS)
+        return;
+
+    std::size_t published;
+    {
+        std::scoped_lock lock(queue_mutex);
+        queue.push_back(&job);
+        published = queue.size();
+    }
+    queue_cv.notify_one();
+    // a worker per job, like when all jobs start at once
+    EnsureWorkers(published);
+}
+
+SimplifierThread* FormulaSimplifier::NextJob()
+{
+    std::unique_lock lock(queue_mutex);
+    queue_cv.wait(lock, [this] { return next_job < queue.size() || queue_closed || stop; });
+    if (stop || next_job >= queue.size())
+        return nullptr;
+    return queue[next_job++];
+}
+
+void FormulaSimplifier::EnsureWorkers(std::size_t n)
+{
+    if (settings.max_threads > 0)
+        n = std::min(n, (std::size_t)settings.max_threads);
+
+    while (workers.size() < n)
+    {
+        std::size_t i = workers.size();
+        auto& ctx = worker_contexts.emplace_back();
+        workers.emplace_back([this, i, &ctx] {
+            FBSTracer::SetCurrent(env.tracer);
+            if (env.tracer)
+                env.tracer->SetThreadName("worker " + std::to_string(i));
+            auto run = [&](SimplifierThread* job) {
+                if (!ctx)
+                {
+                    TraceScope trace("AcquireContext");
+                    auto start = std::chrono::steady_clock::now();
+                    bool reused;
+                    ctx = contexts.Acquire(reused);
+                    stats.AddContext(reused, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                }
+                job->Run(*ctx);
+            };
+
+            while (auto* job = NextJob())
+                run(job);
+            // no jobs left, help the ones still running
+            while (auto* spec = StartSpeculation())
+                run(spec);
+        });
+    }
+}
+
+void FormulaSimplifier::StartWorkers()
+{
+    if (settings.schedule == Schedule::ROUNDS)
+    {
+        std::vector<SimplifierThread*> jobs;
+        for (auto& t : threads)
+            jobs.push_back(&t);
+        StartRoundWorkers(jobs);
+        return;
+    }
+
+    // all jobs are published, the workers that find the queue empty start
+    // speculative runs, and with speculation the spare cores get workers too
+    std::size_t published;
+    {
+        std::scoped_lock lock(queue_mutex);
+        queue_closed = true;
+        published = queue.size();
+    }
+    queue_cv.notify_all();
+    if (settings.speculative_runs > 0)
+        EnsureWorkers(std::min((std::size_t)std::thread::hardware_concurrency(), published * (1 + settings.speculative_runs)));
+}
+
+void FormulaSimplifier::StartRoundWorkers(const std::vector<SimplifierThread*>& jobs)
+{
+    for (auto* job : jobs)
+        schedule.emplace_back(job);
+
+    // more workers than cores would only slow down the cheap first rounds
+    std::size_t n = std::min(jobs.size(), (std::size_t)std::max(1u, std::thread::hardware_concurrency()));
+    if (settings.max_threads > 0)
+        n = std::min(n, (std::size_t)settings.max_threads);
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        workers.emplace_back([this, i] {
+            FBSTracer::SetCurrent(env.tracer);
+            if (env.tracer)
+                env.tracer->SetThreadName("worker " + std::to_string(i));
+
+            std::unique_lock lock(schedule_mutex);
+            while (true)
+            {
+                ScheduledJob* next = PickRound();
+                if (!next)
+                {
+                    if (std::all_of(schedule.begin(), schedule.end(), [](const auto& s) { return s.done; }))
+                        break;
+                    // woken up when a round ends
+                    schedule_cv.wait(lock);
+                    continue;
+                }
+                next->running = true;
+                lock.unlock();
+
+                bool more;
+                if (!next->started)
+                {
+                    next->started = true;
+                    auto start = std::chrono::steady_clock::now();
+                    bool reused;
+                    next->ctx = contexts.Acquire(reused);
+                    stats.AddContext(reused, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                    more = next->job->Start(*next->ctx);
+                }
+                else
+                {
+                    more = next->job->Step();
+                }
+                if (!more)
+                    next->job->Finish();
+
+                lock.lock();
+                next->running = false;
+                next->done = !more;
+                schedule_cv.notify_all();
+            }
+        });
+    }
+}
+
+FormulaSimplifier::ScheduledJob* FormulaSimplifier::PickRound()
+{
+    // every job gets its first cheap rounds breadth-first, then the job whose
+    // last round changed the approximation the most per second goes next
+    constexpr int warmup_rounds = 2;
+    auto before = [](const ScheduledJob& a, const ScheduledJob& b) {
+        int ra = a.job->GetRounds(), rb = b.job->GetRounds();
+        if ((ra < warmup_rounds) != (rb < warmup_rounds))
+            return ra < warmup_rounds;
+        if (ra < warmup_rounds)
+            return ra < rb || (ra == rb && !a.started && b.started);
+        return a.job->GetGainRate() > b.job->GetGainRate();
+    };
+
+    ScheduledJob* best = nullptr;
+    for (auto& s : schedule)
+    {
+        if (!s.running && !s.done && (!best || before(s, *best)))
+            best = &s;
+    }
+    return best;
+}
+
+bool FormulaSimplifier::ShouldHandOff(clck::time_point jobs_start, clck::time_point& last_progress, int& progress)
+{
+    int current = 0;
+    std::size_t running = 0;
+    for (const auto& t : threads)
+    {
+        current += t.GetProgress();
+        running += !t.IsFinished();
+    }
+    auto now = clck::now();
+    if (current != progress)
+    {
+        progress = current;
+        last_progress = now;
+        return false;
+    }
+    // no approximation yet, the first one is worth the whole budget
+    if (progress == 0)
+        return false;
+
+    // the longer the approximations kept changing, the longer the wait for
+    // the next change, finished jobs will not bring any
+    double productive = std::max(0.1, std::chrono::duration<double>(last_progress - jobs_start).count());
+    double waited = std::chrono::duration<double>(now - last_progress).count();
+    double share = (double)running / threads.size();
+    return waited > settings.handoff_ratio * productive * share;
+}
+
+SimplifierThread* FormulaSimplifier::StartSpeculation()
+{
+    if (settings.speculative_runs <= 0 || stop)
+        return nullptr;
+
+    std::scoped_lock lock(speculation_mutex);
+    // the running job with the fewest speculative runs, the one that got
+    // furthest among those
+    SimplifierThread* target = nullptr;
     for (auto& t : threads)
-        t.WaitForResult();
-    return out;
+    {
+        if (!t.CanSpeculate() || t.GetSpeculationCount() >= (std::size_t)settings.speculative_runs)
+            continue;
+        if (!target || t.GetSpeculationCount() < target->GetSpeculationCount()
+            || (t.GetSpeculationCount() == target->GetSpeculationCount() && t.GetCurrentBw() > target->GetCurrentBw()))
+            target = &t;
+    }
+    if (!target)
+        return nullptr;
+
+    // every further run skips more of the widths the job still has to go through
+    int bw = std::max(2, target->GetCurrentBw() + 2 * (int)(target->GetSpeculationCount() + 1));
+    if (bw > 128)
+        return nullptr;
+
+    auto& spec = speculative.emplace_back(env, *target, bw, target->GetCurrentPrec());
+    target->AddSpeculation(&spec);
+    logger.Log("Speculative run from bw " + std::to_string(bw));
+    return &spec;
+}
+
+void FormulaSimplifier::JoinWorkers()
+{
+    {
+        std::scoped_lock lock(queue_mutex);
+        queue_closed = true;
+    }
+    queue_cv.notify_all();
+    for (auto& w : workers)
+    {
+        if (w.joinable())
+            w.join();
+    }
 }
 
 z3::expr FormulaSimplifier::RunSimplifications()
 {
-    ExprSimplifier simplifier(expr.ctx(), true, true);
+    // the propagation of unconstrained terms keeps only satisfiability,
+    // a model of its result is not one of the input
+    ExprSimplifier simplifier(expr.ctx(), !settings.produce_models, true);
     logger.Log("Simplifying...");
-    expr = simplifier.Simplify(expr);
-    expr = RemoveInternal(expr);
-    logger.DumpFormula("simplified.smt2", expr);
-    logger.DumpFormula("out.smt2", expr);
+    {
+        TraceScope trace("ExprSimplifier");
+        expr = simplifier.Simplify(expr);
+    }
+    stats.MarkPhase("ExprSimplifier");
 
-    std::vector<int> quant_cnts;
-    CountQuantifiers(expr, 0, quant_cnts);
-    int depth = 0;
-    int total = 0;
-    while ((!settings.max_quants || total < settings.max_quants) && depth < (int)quant_cnts.size())
-        total += quant_cnts[depth++];
-    logger.Log("Using depth = " + std::to_string(depth) + "/" + std::to_string(quant_cnts.size()) + " with " + std::to_string(total) + " total quantifiers");
+    // the jobs get everything up to the tail, time left over by the
+    // preprocessing or by jobs that finish early goes to the running ones
+    int tail_ms = settings.reserve_ms >= 0 ? settings.reserve_ms : std::min(settings.timeout_ms / 10, 2000);
+    jobs_budget = time_manager.WithoutTail(tail_ms);
+    if (settings.timeout_ms)
+        logger.Log("Time budget: " + std::to_string(time_manager.RemainingMs()) + " ms left, " + std::to_string(jobs_budget.RemainingMs()) + " ms for the jobs, "
+            + std::to_string(tail_ms) + " ms reserved");
 
+    // Without a limit on the number of quantifiers, the selection of one
+    // top-level conjunct does not depend on the others. Each conjunct is
+    // then preprocessed and gets its jobs on its own, and the workers start
+    // on the jobs of the first conjuncts while the rest is preprocessed.
+    bool pipelined = settings.schedule == Schedule::JOBS && settings.selection == Selection::DEPTH && !settings.max_quants;
     std::vector<z3::expr> bound;
-    LaunchThreads(expr, depth, bound);
+    int depth = 0;
+    TraceScope launch_trace("LaunchThreads");
+    if (pipelined)
+    {
+        depth = settings.max_depth ? settings.max_depth : std::numeric_limits<int>::max();
+        z3::expr_vector parts(expr.ctx());
+        // the preprocessing is interleaved with the launch, its time is
+        // summed over the conjuncts and recorded as a phase of its own
+        double preprocess_seconds = 0;
+        // shared by the conjuncts, so that a quantifier they share is still
+        // one term after miniscoping; it keeps the temporaries of all of them
+        // alive and is released once the last conjunct is done
+        MiniscopeCache miniscope_cache;
+        auto process = [&](z3::expr part) {
+            auto start = std::chrono::steady_clock::now();
+            part = Preprocess(part, miniscope_cache);
+            preprocess_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            AddTopConjuncts(part);
+            LaunchThreads(part, depth, bound);
+            parts.push_back(part);
+        };
+        if (expr.is_app() && expr.decl().decl_kind() == Z3_OP_AND)
+        {
+            for (unsigned i = 0; i < expr.num_args(); ++i)
+                process(expr.arg(i));
+        }
+        else
+        {
+            process(expr);
+        }
+        // the same shape LaunchThreads saw, Simplify takes the jobs in order
+        expr = parts.size() == 1 ? parts[0] : z3::mk_and(parts);
+        miniscope_cache.clear();
+        stats.AddPhase("Preprocess", preprocess_seconds);
+        logger.Log("Pipelined launch over " + std::to_string(parts.size()) + " conjuncts");
+        launch_trace.AddArg("conjuncts", (long long)parts.size());
+    }
+    else
+    {
+        {
+            MiniscopeCache miniscope_cache;
+            expr = Preprocess(expr, miniscope_cache);
+        }
+        stats.MarkPhase("Preprocess");
+
+        std::vector<int> quant_cnts;
+        CountQuantifiers(expr, 0, quant_cnts);
+        if (settings.selection == Selection::COST)
+        {
+            // the depth only bounds the traversal, HasJob decides
+            TraceScope trace("SelectByCost");
+            depth = quant_cnts.size();
+            SelectByCost(expr);
+        }
+        else
+        {
+            int total = 0;
+            while ((!settings.max_quants || total < settings.max_quants) && (!settings.max_depth || depth < settings.max_depth) && depth < (int)quant_cnts.size())
+                total += quant_cnts[depth++];
+            logger.Log("Using depth = " + std::to_string(depth) + "/" + std::to_string(quant_cnts.size()) + " with " + std::to_string(total) + " total quantifiers");
+        }
+
+        AddTopConjuncts(expr);
+        LaunchThreads(expr, depth, bound);
+    }
+    if (settings.dump_files)
+    {
+        logger.DumpFormula("simplified.smt2", expr);
+        logger.DumpFormula("out.smt2", expr);
+    }
+
     assert(bound.empty());
-    threads.emplace_back(expr, false, bound);
-    logger.Log(std::to_string(threads.size()) + " threads launched");
+    AddJob(expr, false, bound);
+    if (settings.produce_models)
+        threads.back().RequestModel();
+    // its results only decide the formula, they are never substituted
+    if (settings.existential_fast_path && ExistentialsArePositive(expr))
+    {
+        logger.Log("Existential fast path for the whole formula");
+        threads.back().EnableExistentialFastPath();
+    }
+    Publish(threads.back());
+    StartWorkers();
+    launch_trace.AddArg("threads", (long long)threads.size());
+    launch_trace.AddArg("ir_nodes", (long long)ir.NodeCount());
+    launch_trace.AddArg("workers", (long long)workers.size());
+    launch_trace.End();
+    logger.Log(std::to_string(threads.size()) + " threads launched on " + std::to_string(workers.size()) + " workers");
+    stats.MarkPhase("LaunchThreads");
 
-    while (!std::all_of(threads.begin(), threads.end(), [](const auto& t) { return t.IsFinished(); }) && !time_manager.IsTimeout())
+    TraceScope wait_trace("WaitForThreads");
+    auto jobs_start = std::chrono::steady_clock::now();
+    auto last_progress = jobs_start;
+    int progress = 0;
+    while (!std::all_of(threads.begin(), threads.end(), [](const auto& t) { return t.IsFinished(); }) && !jobs_budget.IsTimeout())
+    {
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (std::any_of(refuters.begin(), refuters.end(), [](const auto* t) { return t->IsRefuted(); }))
+        {
+            logger.Log("A top-level quantifier is false, stopping");
+            wait_trace.AddArg("refuted", 1LL);
+            break;
+        }
+        if (settings.handoff_ratio > 0 && ShouldHandOff(jobs_start, last_progress, progress))
+        {
+            double saved = jobs_budget.RemainingMs() / 1000.0;
+            logger.Log("No progress, handing off early with " + std::to_string(saved) + " s left");
+            wait_trace.AddArg("handoff_saved_ms", (long long)(saved * 1000));
+            stats.SetHandoff(saved);
+            break;
+        }
+    }
+    wait_trace.End();
+    stats.MarkPhase("WaitForThreads");
 
-    Solver::resultComputed = true;
-    if (time_manager.IsTimeout())
+    stop = true;
+    if (jobs_budget.IsTimeout())
         logger.Log("Timeout");
+    // jobs of one worker share its context, so the results can only be read
+    // once no job runs, stopped jobs return at the next BDD operation
+    JoinWorkers();
+
+    auto run_stats = stats.GetRunStats();
+    double reset_ms = 0;
+    for (const auto& t : threads)
+        reset_ms += t.GetStats().reset_ms;
+    logger.Log(std::to_string(run_stats.contexts_created) + " contexts created in " + std::to_string(run_stats.context_create_ms) + " ms, "
+        + std::to_string(run_stats.contexts_reused) + " reused, jobs reset in " + std::to_string(reset_ms) + " ms");
+
+    int dropped = 0;
+    for (const auto& t : threads)
+        dropped += t.GetDroppedCount();
+    logger.Log(std::to_string(dropped) + " approximations dropped over the node budget");
     
     z3::expr res(expr.ctx()), expr_o(expr.ctx()), expr_u(expr.ctx());
+    TraceScope simplify_trace("Simplify");
     
     auto& tu = threads.back();
     logger.Log("Getting result from main thread");
-    auto under = Translate(tu.GetResult(), expr.ctx());
+    auto under = tu.GetResult(expr.ctx());
     if (!under.empty())
     {
         logger.Log("Solved using under on the whole formula");
+        model = tu.GetModel();
         res = expr_u = expr_o = expr.ctx().bool_val(true);
     }
     else
@@ -81,8 +865,10 @@ z3::expr FormulaSimplifier::RunSimplifications()
     
         assert(std::next(t_curr) == threads.end());    
     }    
+    simplify_trace.End();
+    stats.MarkPhase("Simplify");
 
-    if (settings.use_over && settings.use_under)
+    if (settings.use_over && settings.use_under && settings.dump_files)
     {
         logger.DumpFormula("out.smt2", res);
         logger.DumpFormula("out_o.smt2", expr_o);
@@ -136,26 +922,27 @@ z3::expr FormulaSimplifier::Simplify(z3::expr e, int depth, std::list<Simplifier
     else if (e.is_quantifier())
     {
         auto bound = GetQuantBoundVars(e);
+        bool has_job = HasJob(e, depth);
 
         if (e.is_forall())
             e = z3::forall(bound, Simplify(e.body(), depth - 1, t_curr, use_over, use_under, n_approx_pick));
         else
             e = z3::exists(bound, Simplify(e.body(), depth - 1, t_curr, use_over, use_under, n_approx_pick));
 
-        if (depth > 0)
+        if (has_job)
         {
             logger.Log("Getting result from thread");
             if (settings.use_under)
             {
                 auto& tu = *t_curr++;
-                auto under = Translate(tu.GetResult(), e.ctx());
+                auto under = tu.GetResult(e.ctx());
                 if (use_under)
                     e = simplifyOr(e.ctx(), {simplifyOr(e.ctx(), PickResults(under, n_approx_pick)), e});
             }
             if (settings.use_over)
             {
                 auto& to = *t_curr++;
-                auto over = Translate(to.GetResult(), e.ctx());
+                auto over = to.GetResult(e.ctx());
                 if (use_over)
                     e = simplifyAnd(e.ctx(), {simplifyAnd(e.ctx(), PickResults(over, n_approx_pick)), e});
             }
@@ -190,12 +977,18 @@ void FormulaSimplifier::LaunchThreads(z3::expr e, int depth, std::vector<z3::exp
         while (bound.size() > curr_size)
             bound.pop_back();
 
-        if (depth > 0)
+        if (HasJob(e, depth))
         {
             if (settings.use_under)
-                threads.emplace_back(e, false, bound);
+            {
+                AddJob(e, false, bound);
+                Publish(threads.back());
+            }
             if (settings.use_over)
-                threads.emplace_back(e, true, bound);
+            {
+                AddJob(e, true, bound);
+                Publish(threads.back());
+            }
         }
     }
 }
@@ -223,6 +1016,194 @@ void FormulaSimplifier::CountQuantifiers(z3::expr e, int depth, std::vector<int>
     }
 }
 
+z3::expr FormulaSimplifier::Preprocess(z3::expr e, MiniscopeCache& cache)
+{
+    {
+        TraceScope trace("RemoveInternal");
+        e = RemoveInternal(e);
+    }
+    if (settings.miniscope)
+    {
+        TraceScope trace("Miniscope");
+        e = Miniscope(e, cache);
+    }
+    return e;
+}
+
+void FormulaSimplifier::AddTopConjuncts(const z3::expr& e)
+{
+    std::vector<z3::expr> todo = {e};
+    while (!todo.empty())
+    {
+        z3::expr curr = todo.back();
+        todo.pop_back();
+        if (curr.is_quantifier())
+            top_conjuncts.insert(Z3_get_ast_id(curr.ctx(), curr));
+        else if (curr.is_app() && curr.decl().decl_kind() == Z3_OP_AND)
+            for (unsigned i = 0; i < curr.num_args(); ++i)
+                todo.push_back(curr.arg(i));
+    }
+}
+
+z3::expr FormulaSimplifier::Miniscope(z3::expr e, MiniscopeCache& cache)
+{
+    auto it = cache.find(Z3_get_ast_id(e.ctx(), e));
+    if (it != cache.end())
+        return it->second.second;
+
+    z3::expr res = e;
+    if (e.is_app() && e.is_bool())
+    {
+        z3::expr_vector sim(e.ctx());
+        for (unsigned i = 0; i < e.num_args(); ++i)
+            sim.push_back(Miniscope(e.arg(i), cache));
+        res = e.decl()(sim);
+    }
+    else if (e.is_quantifier())
+    {
+        // the bound variables become fresh constants, so that the parts of
+        // the body can be moved between quantifiers without reindexing
+        auto bound = GetQuantBoundVars(e);
+        z3::expr_vector consts(e.ctx());
+        std::vector<z3::expr> vars;
+        for (unsigned i = 0; i < bound.size(); ++i)
+        {
+            auto b = bound[bound.size() - 1 - i];
+            consts.push_back(z3::expr(e.ctx(), Z3_mk_fresh_const(e.ctx(), b.decl().name().str().c_str(), b.get_sort())));
+        }
+        for (unsigned i = consts.size(); i-- > 0;)
+            vars.push_back(consts[i]);
+        res = PushQuantifier(e.is_forall(), vars, Miniscope(e.body().substitute(consts), cache));
+    }
+
+    cache.emplace(Z3_get_ast_id(e.ctx(), e), std::make_pair(e, res));
+    return res;
+}
+
+z3::expr FormulaSimplifier::PushQuantifier(bool forall, const std::vector<z3::expr>& vars, z3::expr body)
+{
+    // forall distributes over and, exists over or; over the other operator
+    // the quantifier splits into groups of parts connected by shared
+    // variables, the parts without any of them move out
+    Z3_decl_kind split_kind = forall ? Z3_OP_AND : Z3_OP_OR;
+    Z3_decl_kind group_kind = forall ? Z3_OP_OR : Z3_OP_AND;
+    bool split = body.is_app() && body.decl().decl_kind() == split_kind;
+    bool group = body.is_app() && body.decl().decl_kind() == group_kind;
+
+    std::vector<z3::expr> parts;
+    if (split || group)
+    {
+        for (unsigned i = 0; i < body.num_args(); ++i)
+            parts.push_back(body.arg(i));
+    }
+    else
+    {
+        parts.push_back(body);
+    }
+
+    // indices of the variables used by each part
+    std::unordered_map<unsigned, std::size_t> var_index;
+    for (std::size_t i = 0; i < vars.size(); ++i)
+        var_index.emplace(Z3_get_ast_id(body.ctx(), vars[i]), i);
+    std::vector<std::set<std::size_t>> used(parts.size());
+    std::set<std::size_t> all_used;
+    for (std::size_t p = 0; p < parts.size(); ++p)
+    {
+        std::unordered_set<unsigned> visited;
+        std::vector<z3::expr> todo = {parts[p]};
+        while (!todo.empty())
+        {
+            z3::expr curr = todo.back();
+            todo.pop_back();
+            if (!visited.insert(Z3_get_ast_id(curr.ctx(), curr)).second)
+                continue;
+            if (curr.is_const())
+            {
+                auto it = var_index.find(Z3_get_ast_id(curr.ctx(), curr));
+                if (it != var_index.end())
+                    used[p].insert(it->second);
+            }
+            else if (curr.is_app())
+            {
+                for (unsigned i = 0; i < curr.num_args(); ++i)
+                    todo.push_back(curr.arg(i));
+            }
+            else if (curr.is_quantifier())
+            {
+                todo.push_back(curr.body());
+            }
+        }
+        all_used.insert(used[p].begin(), used[p].end());
+    }
+
+    auto vars_of = [&](const std::set<std::size_t>& ids) {
+        std::vector<z3::expr> res;
+        for (auto i : ids)
+            res.push_back(vars[i]);
+        return res;
+    };
+    auto quantify = [&](const std::set<std::size_t>& ids, z3::expr e) {
+        if (ids.empty())
+            return e;
+        z3::expr_vector xs(e.ctx());
+        for (auto i : ids)
+            xs.push_back(vars[i]);
+        return forall ? z3::forall(xs, e) : z3::exists(xs, e);
+    };
+
+    std::vector<z3::expr> res;
+    if (split)
+    {
+        for (std::size_t p = 0; p < parts.size(); ++p)
+            res.push_back(PushQuantifier(forall, vars_of(used[p]), parts[p]));
+        return forall ? simplifyAnd(body.ctx(), res) : simplifyOr(body.ctx(), res);
+    }
+    if (!group)
+        return quantify(all_used, body);
+
+    // union-find over the variables
+    std::vector<std::size_t> parent(vars.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](std::size_t i) {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    };
+    for (const auto& u : used)
+    {
+        for (auto i : u)
+            parent[find(i)] = find(*u.begin());
+    }
+
+    // groups in the order of their first parts
+    std::vector<std::size_t> roots;
+    std::unordered_map<std::size_t, std::vector<z3::expr>> group_parts;
+    std::unordered_map<std::size_t, std::set<std::size_t>> group_vars;
+    for (std::size_t p = 0; p < parts.size(); ++p)
+    {
+        if (used[p].empty())
+        {
+            res.push_back(parts[p]);
+            continue;
+        }
+        auto root = find(*used[p].begin());
+        if (!group_parts.count(root))
+            roots.push_back(root);
+        group_parts[root].push_back(parts[p]);
+        group_vars[root].insert(used[p].begin(), used[p].end());
+    }
+    if (roots.size() == 1 && res.empty())
+        return quantify(all_used, body);
+
+    for (auto root : roots)
+    {
+        const auto& g = group_parts[root];
+        auto sub = forall ? simplifyOr(body.ctx(), g) : simplifyAnd(body.ctx(), g);
+        res.push_back(PushQuantifier(forall, vars_of(group_vars[root]), sub));
+    }
+    return forall ? simplifyOr(body.ctx(), res) : simplifyAnd(body.ctx(), res);
+}
+
 z3::expr FormulaSimplifier::RemoveInternal(z3::expr e)
 {
     if (e.is_app())
@@ -1,16 +1,58 @@
 #pragma once
 #include <map>
 #include <list>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #include <z3++.h>
 #include "ExprToBDDTransformer.h"
 #include "SimplifierThread.h"
+#include "FormulaIR.h"
+#include "ContextPool.h"
+#include "TimeoutManager.h"
+#include "FBSLogger.h"
+#include "FBSStats.h"
+#include "Settings.h"
+#include "Solver.h"
+#include "Model.h"
 
+struct SimplifyResult
+{
+    SimplifyResult(z3::expr e, RunStats s) : expr(e), stats(std::move(s)) {}
+
+    z3::expr expr;
+    RunStats stats;
+    // SAT or UNSAT if the simplified formula is a constant, the model is
+    // only filled for SAT with Settings::produce_models, and only if it
+    // satisfies the input
+    Result verdict = NORESULT;
+    Model model;
+    bool has_model = false;
+};
+
+// Simplifies one formula. All state lives in the object, so any number of
+// simplifiers (each with its own z3::context) can run concurrently. The
+// contexts of the workers come from `pool` if given, so that they are reused
+// by the next simplifier.
 class FormulaSimplifier
 {
 public:
-    FormulaSimplifier(z3::expr expr) : expr(expr) {}
+    FormulaSimplifier(z3::expr expr, const Settings& s = Settings(), ContextPool* pool = nullptr)
+        : settings(s), env{settings, logger, stop, jobs_budget, FBSTracer::Current(), expr.ctx()}, expr(expr), contexts(pool ? *pool : own_contexts)
+    {
+        logger.SetEnabled(settings.verbose);
+        time_manager.SetTimeoutMs(settings.timeout_ms);
+    }
 
-    z3::expr Run();
+    ~FormulaSimplifier();
+
+    SimplifyResult Run();
     z3::expr RunSimplifications();
 
     z3::expr Simplify(z3::expr e, int depth, std::list<SimplifierThread>::iterator& t_curr, bool use_over, bool use_under, int n_approx_pick);
@@ -21,9 +63,103 @@ public:
 
 private:
     z3::expr RemoveInternal(z3::expr e);
+    // results of Miniscope by the AST id of its input; Z3 reuses the ids of
+    // freed ASTs, so the input is kept alive next to its result
+    using MiniscopeCache = std::unordered_map<unsigned, std::pair<z3::expr, z3::expr>>;
+    // moves quantifiers inwards over and/or and drops unused bound variables
+    z3::expr Miniscope(z3::expr e, MiniscopeCache& cache);
+    z3::expr PushQuantifier(bool forall, const std::vector<z3::expr>& vars, z3::expr body);
 
     std::vector<z3::expr> PickResults(const std::vector<z3::expr>& approx, int n);
+
+    bool Triage();
+    Model ZeroModel(const z3::expr& e) const;
+    // whether the model completed by defaults satisfies e
+    bool CheckModel(const Model& m, const z3::expr& e) const;
+    void AddJob(z3::expr e, bool over, const std::vector<z3::expr>& bound);
+    void LinkSummaries(SimplifierThread& job, const z3::expr& e, bool over);
+    void SelectByCost(z3::expr e);
+    void CollectQuantifiers(z3::expr e, int depth, std::vector<z3::expr>& res);
+    bool HasJob(const z3::expr& q, int depth) const;
+    z3::expr Preprocess(z3::expr e, MiniscopeCache& cache);
+    void AddTopConjuncts(const z3::expr& e);
+    void Publish(SimplifierThread& job);
+    SimplifierThread* NextJob();
+    void EnsureWorkers(std::size_t n);
+    void StartWorkers();
+    void StartRoundWorkers(const std::vector<SimplifierThread*>& jobs);
+    SimplifierThread* StartSpeculation();
+    using clck = std::chrono::steady_clock;
+    bool ShouldHandOff(clck::time_point jobs_start, clck::time_point& last_progress, int& progress);
+    void JoinWorkers();
+
+    Settings settings;
+    TimeoutManager time_manager;
+    // the time manager without the tail reserved for the assembly
+    TimeoutManager jobs_budget;
+    FBSLogger logger;
+    FBSStats stats;
+    std::atomic<bool> stop = false;
+    SimplifierEnv env;
+
     z3::expr expr;
 
+    // of the whole formula job if it decided the formula
+    std::optional<Model> model;
+
+    // the quantifiers among the top-level conjuncts by AST id, and their
+    // over-approximation jobs, once one of them is false so is the formula
+    std::unordered_set<unsigned> top_conjuncts;
+    std::vector<const SimplifierThread*> refuters;
+
+    // the under- and over-approximation jobs of the quantifiers by AST id
+    struct QuantJobs
+    {
+        const SimplifierThread* under = nullptr;
+        const SimplifierThread* over = nullptr;
+    };
+    std::unordered_map<unsigned, QuantJobs> quant_jobs;
+
+    // Selection::COST, the quantifiers with jobs and their predicted cost
+    // per job, by AST id
+    std::unordered_map<unsigned, double> selected;
+
+    ContextPool own_contexts;
+    ContextPool& contexts;
+    // one per worker, returned to the pool when the jobs are destroyed;
+    // workers are added while the others run, so they must not move
+    std::deque<std::unique_ptr<z3::context>> worker_contexts;
+
+    // shared by all jobs, the workers start while it is still extended
+    FormulaIR ir;
     std::list<SimplifierThread> threads;
-};
\ No newline at end of file
+    // speculative runs added by idle workers
+    std::list<SimplifierThread> speculative;
+    std::mutex speculation_mutex;
+
+    // Schedule::ROUNDS, a job may run its rounds on different workers, so
+    // it gets a context of its own
+    struct ScheduledJob
+    {
+        explicit ScheduledJob(SimplifierThread* j) : job(j) {}
+
+        SimplifierThread* job;
+        bool started = false;
+        bool running = false;
+        bool done = false;
+        std::unique_ptr<z3::context> ctx;
+    };
+    std::vector<ScheduledJob> schedule;
+    std::mutex schedule_mutex;
+    std::condition_variable schedule_cv;
+    ScheduledJob* PickRound();
+    std::vector<std::thread> workers;
+
+    // Schedule::JOBS, the jobs in the order they were added, a worker takes
+    // the next one as soon as it is published; closed once all are
+    std::vector<SimplifierThread*> queue;
+    std::size_t next_job = 0;
+    bool queue_closed = false;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+};
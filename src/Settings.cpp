@@ -1,3 +0,0 @@
-#include "Settings.h"
-
-Settings settings;
\ No newline at end of file
@@ -1,10 +1,76 @@
 #pragma once
 
+enum class Encoding
+{
+    ITE,
+    WORD,
+    DNF,
+};
+
+enum class Schedule
+{
+    // every job runs all its rounds once a worker picks it up
+    JOBS,
+    // workers run single rounds of the jobs, breadth-first at first
+    ROUNDS,
+};
+
+enum class Selection
+{
+    // all quantifiers up to the depth given by max_quants and max_depth
+    DEPTH,
+    // the quantifiers whose predicted cost fits the cores and the timeout
+    COST,
+};
+
+// Options of one simplification. Every FormulaSimplifier keeps its own copy,
+// so simplifications with different options can run in one process.
 struct Settings
 {
     bool use_over = true;
     bool use_under = false;
     int max_quants = 0;
+    // push quantifiers inwards before the jobs are created, so that they get
+    // smaller bodies with fewer variables
+    bool miniscope = true;
+    Selection selection = Selection::DEPTH;
+    // maximum quantifier nesting depth with simplifier jobs, 0 for no limit
+    int max_depth = 0;
+    // maximum number of jobs running at the same time, 0 for no limit
+    int max_threads = 0;
+    // speculative runs of one job at higher bit-widths on otherwise idle
+    // workers, 0 to disable
+    int speculative_runs = 2;
+    Schedule schedule = Schedule::JOBS;
+    // wall-clock limit of the whole simplification in ms, 0 for no limit
+    int timeout_ms = 0;
+    // end of the limit kept for assembling the result in ms, -1 for a tenth
+    // of the limit up to 2 s
+    int reserve_ms = -1;
+    // stop the jobs early once no approximation changed for this multiple of
+    // the time it took to get the approximations so far, shortened by the
+    // share of finished jobs, 0 to always use the whole budget
+    double handoff_ratio = 0;
+    Encoding encoding = Encoding::ITE;
+    int dnf_k = 5;
+    bool minimize = true;
+    int max_approx_nodes = 0;
+    // decide from cheap features and short probes whether to simplify at all
+    bool triage = false;
+    int triage_probe_ms = 50;
+    // a formula decided by the approximations comes with a model, so the
+    // preprocessing keeps all solutions instead of only satisfiability
+    bool produce_models = false;
+    // simplify the components of the assertions that share no free
+    // constants one after another, each in its share of the time limit
+    bool split_components = true;
+    // let the whole formula job treat the outer existential variables like
+    // free ones, if they all occur positively under and/or
+    bool existential_fast_path = true;
+    // jobs replace the inner quantifiers whose jobs are already finished by
+    // their approximations
+    bool summaries = true;
+    bool verbose = false;
+    // writes the intermediate and final formulas to out.smt2 and friends
+    bool dump_files = false;
 };
-
-extern Settings settings;
\ No newline at end of file
@@ -1,3 +1,7 @@
+#include <set>
+#include <map>
+#include <numeric>
+
 #include "SimplifierBasic.h"
 
 bool isTrue(z3::expr e)
@@ -97,3 +101,112 @@ z3::expr decorateFormula(z3::expr e, z3::expr under, z3::expr over)
         return under;
     return simplifyAnd(e.ctx(), {over, simplifyOr(e.ctx(), {under, e})}); 
 }
+
+unsigned formulaSize(z3::expr e)
+{
+    std::set<unsigned> visited;
+    std::vector<z3::expr> todo{e};
+    while (!todo.empty())
+    {
+        z3::expr curr = todo.back();
+        todo.pop_back();
+        if (!visited.insert(curr.id()).second)
+            continue;
+        if (curr.is_app())
+        {
+            for (unsigned i = 0; i < curr.num_args(); ++i)
+                todo.push_back(curr.arg(i));
+        }
+        else if (curr.is_quantifier())
+        {
+            todo.push_back(curr.body());
+        }
+    }
+    return visited.size();
+}
+
+static void collectConstants(z3::expr e, std::set<std::string>& res)
+{
+    std::set<unsigned> visited;
+    std::vector<z3::expr> todo{e};
+    while (!todo.empty())
+    {
+        z3::expr curr = todo.back();
+        todo.pop_back();
+        if (!visited.insert(curr.id()).second)
+            continue;
+        if (curr.is_const() && !curr.is_numeral() && curr.decl().decl_kind() == Z3_OP_UNINTERPRETED)
+        {
+            res.insert(curr.to_string());
+        }
+        else if (curr.is_app())
+        {
+            for (unsigned i = 0; i < curr.num_args(); ++i)
+                todo.push_back(curr.arg(i));
+        }
+        else if (curr.is_quantifier())
+        {
+            todo.push_back(curr.body());
+        }
+    }
+}
+
+std::vector<z3::expr> splitComponents(z3::expr e)
+{
+    std::vector<z3::expr> conjuncts;
+    std::vector<z3::expr> todo{e};
+    while (!todo.empty())
+    {
+        z3::expr curr = todo.back();
+        todo.pop_back();
+        if (curr.is_app() && curr.decl().decl_kind() == Z3_OP_AND)
+        {
+            for (unsigned i = curr.num_args(); i-- > 0;)
+                todo.push_back(curr.arg(i));
+        }
+        else
+        {
+            conjuncts.push_back(curr);
+        }
+    }
+
+    // union-find over the conjuncts, joined by their constants
+    std::vector<std::size_t> parent(conjuncts.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](std::size_t i) {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    };
+
+    std::map<std::string, std::size_t> owner;
+    std::vector<bool> ground(conjuncts.size(), false);
+    for (std::size_t i = 0; i < conjuncts.size(); ++i)
+    {
+        std::set<std::string> constants;
+        collectConstants(conjuncts[i], constants);
+        ground[i] = constants.empty();
+        for (const auto& c : constants)
+        {
+            auto [it, inserted] = owner.emplace(c, i);
+            if (!inserted)
+                parent[find(i)] = find(it->second);
+        }
+    }
+
+    std::vector<std::vector<z3::expr>> groups;
+    std::map<std::size_t, std::size_t> group_of;
+    for (std::size_t i = 0; i < conjuncts.size(); ++i)
+    {
+        std::size_t root = ground[i] ? conjuncts.size() : find(i);
+        auto [it, inserted] = group_of.emplace(root, groups.size());
+        if (inserted)
+            groups.emplace_back();
+        groups[it->second].push_back(conjuncts[i]);
+    }
+
+    std::vector<z3::expr> res;
+    for (const auto& g : groups)
+        res.push_back(simplifyAnd(e.ctx(), g));
+    return res;
+}
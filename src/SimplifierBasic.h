@@ -10,4 +10,11 @@ z3::expr simplifyAnd(z3::context& ctx, const std::vector<z3::expr>& in);
 z3::expr simplifyIte(z3::expr c, z3::expr t, z3::expr f);
 z3::expr decorateFormula(z3::expr e, z3::expr under, z3::expr over);
 
+unsigned formulaSize(z3::expr e);
+
+// Conjunctions of the top-level conjuncts of e grouped by shared free
+// constants, in the order of their first conjuncts. Conjuncts without free
+// constants form one component.
+std::vector<z3::expr> splitComponents(z3::expr e);
+
 
@@ -1,10 +1,15 @@
 #include <iostream>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
 
 #include "SimplifierThread.h"
 #include "SimplifierBasic.h"
+#include "WordEncoder.h"
 #include "FBSLogger.h"
-
-#include "Solver.h"
+#include "FBSTracer.h"
+#include "Settings.h"
 
 z3::expr Translate(z3::expr e, z3::context& ctx)
 {
@@ -40,92 +45,466 @@ z3::expr_vector GetQuantBoundVars(z3::expr e)
     return res;
 }
 
-void SimplifierThread::Run()
+std::string SimplifierThread::JobName() const
 {
-    expr = CollectVars(expr, 0);
+    std::string name = overapproximate ? "over" : "under";
+    if (origin)
+        name = "speculative " + name + " from bw " + std::to_string(start_bw);
+    if (expr.is_quantifier())
+    {
+        for (const auto& b : GetQuantBoundVars(expr))
+            name += " " + b.to_string();
+    }
+    else
+    {
+        name += " (whole formula)";
+    }
+    return name;
+}
 
-    transformer = std::make_unique<ExprToBDDTransformer>(expr.ctx(), expr, Config());
+void SimplifierThread::Run(z3::context& worker_ctx)
+{
+    FBSTracer::SetCurrent(tracer);
+    TraceScope trace("Job");
+    if (Start(worker_ctx))
+    {
+        trace.AddArg("name", job_stats.name);
+        while (Step())
+            ;
+    }
+    Finish();
+}
 
-    RunApprox();
+bool SimplifierThread::Start(z3::context& worker_ctx)
+{
+    double cpu_start = ThreadCPUSeconds();
+    job_stats.name = "(not started)";
+    started = true;
+
+    bool ok = false;
+    if (!Stopped())
+    {
+        try
+        {
+            auto setup_start = std::chrono::steady_clock::now();
+            if (ir)
+                ctx = &worker_ctx;
+            BuildExpr();
+            job_stats.name = JobName();
+
+            Prepare();
+            job_stats.setup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setup_start).count();
+            ok = true;
+        }
+        catch (const std::exception& e)
+        {
+            logger.Log(std::string("Job stopped: ") + e.what());
+        }
+    }
+
+    job_stats.cpu_seconds += ThreadCPUSeconds() - cpu_start;
+    return ok;
+}
+
+bool SimplifierThread::Step()
+{
+    double cpu_start = ThreadCPUSeconds();
+    auto round_start = std::chrono::steady_clock::now();
+    int prev_nodes = job_stats.node_counts.empty() ? 0 : job_stats.node_counts.back();
+
+    if (budget.IsTimeout())
+    {
+        logger.Log("Job out of time");
+        return false;
+    }
 
+    bool more = false;
+    try
+    {
+        more = RunRound();
+        if (!more && !Stopped())
+        {
+            logger.Log("Done (" + std::to_string(minimized) + " minimized, " + std::to_string(dropped) + " dropped)");
+            completed = true;
+            (origin ? origin : this)->cancelled = true;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        // BDD operations throw when the termination callback stops them
+        logger.Log(std::string("Job stopped: ") + e.what());
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - round_start).count();
+    int nodes = job_stats.node_counts.empty() ? 0 : job_stats.node_counts.back();
+    gain_rate = (std::abs(nodes - prev_nodes) + 1) / std::max(seconds, 1e-6);
+    job_stats.cpu_seconds += ThreadCPUSeconds() - cpu_start;
+    return more;
+}
+
+void SimplifierThread::Finish()
+{
+    CollectStats();
+    {
+        TraceScope reset_trace("Reset");
+        auto reset_start = std::chrono::steady_clock::now();
+        Reset();
+        job_stats.reset_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reset_start).count();
+    }
     finished = true;
 }
 
-void SimplifierThread::RunApprox()
+void SimplifierThread::Reset()
+{
+    // the worker runs its next job in the same context and the memory of
+    // finished jobs should not add up, so everything is released now instead
+    // of when the simplifier finishes, the BDDs before their manager
+    prev_approx.reset();
+    expr_cache.clear();
+    approx_expr_cache.clear();
+    vars.clear();
+    idx_to_var.clear();
+    transformer.reset();
+
+    ExportResult();
+    pre_bound.clear();
+    if (ctx)
+        expr = z3::expr(*ctx);
+}
+
+void SimplifierThread::ExportResult()
+{
+    for (const auto& r : result)
+    {
+        auto id = result_ir.Add(r);
+        if (!id)
+        {
+            // kept as terms, translated by GetResult
+            result_ir.Clear();
+            result_ids.clear();
+            return;
+        }
+        result_ids.push_back(*id);
+    }
+    // nothing is added later, the terms are released with the context
+    result_ir.ReleaseASTs();
+    result.clear();
+    exported = true;
+}
+
+std::vector<z3::expr> SimplifierThread::GetResult(z3::context& c) const
 {
-    if (Solver::resultComputed)
+    const SimplifierThread* best = this;
+    for (const auto* s : speculations)
+    {
+        if (s->result_bw > best->result_bw)
+            best = s;
+    }
+
+    // the approximations of different runs are all sound, the speculative
+    // ones are just more precise
+    auto res = GetOwnResult(c);
+    if (best != this)
+    {
+        auto more = best->GetOwnResult(c);
+        res.insert(res.end(), more.begin(), more.end());
+    }
+    return res;
+}
+
+std::optional<z3::expr> SimplifierThread::GetSummary(z3::context& c) const
+{
+    // the results are immutable once the job is finished
+    if (!finished || !ir || !exported || result_ids.empty())
+        return std::nullopt;
+
+    std::vector<z3::expr> approx;
+    for (auto id : result_ids)
+        approx.push_back(result_ir.Build(id, c));
+    z3::expr res = overapproximate ? simplifyAnd(c, approx) : simplifyOr(c, approx);
+
+    // the results use constants for the bound variables, the last one bound
+    // is the de Bruijn variable 0 at the root of the subformula
+    z3::expr_vector from(c), to(c);
+    for (std::size_t i = 0; i < ir_bound.size(); ++i)
+    {
+        auto b = ir->Build(ir_bound[i], c);
+        from.push_back(b);
+        to.push_back(z3::expr(c, Z3_mk_bound(c, ir_bound.size() - 1 - i, b.get_sort())));
+    }
+    return res.substitute(from, to);
+}
+
+std::optional<Model> SimplifierThread::GetModel() const
+{
+    const SimplifierThread* best = this;
+    for (const auto* s : speculations)
+    {
+        if (s->model && (!best->model || s->result_bw > best->result_bw))
+            best = s;
+    }
+    return best->model;
+}
+
+Model SimplifierThread::ExtractModel(const BDD& bdd)
+{
+    // one satisfying path of the approximation, the variables it does not
+    // mention are zero, as are the bits FixUnder fixed for the bit-width
+    std::vector<char> cube(transformer->bddManager.ReadSize(), 0);
+    bdd.PickOneCube(cube.data());
+    auto value = [&](const BDD& bit) {
+        if (bit.IsZero() || bit.IsOne())
+            return bit.IsOne();
+        return cube[bit.NodeReadIndex()] == 1;
+    };
+
+    // bits in the order of the bit-vector, least significant first
+    Model res;
+    for (auto&[n, v] : vars)
+    {
+        auto it = transformer->vars.find(n);
+        auto sort = v.get_sort();
+        if (sort.is_bool())
+        {
+            res[n] = it != transformer->vars.end() && it->second.bitnum() > 0 && value(it->second[0].GetBDD());
+            continue;
+        }
+        if (!sort.is_bv())
+            continue;
+        std::vector<bool> bits(sort.bv_size(), false);
+        if (it != transformer->vars.end())
+        {
+            for (int i = 0; i < it->second.bitnum() && i < (int)bits.size(); ++i)
+                bits[i] = value(it->second[i].GetBDD());
+        }
+        res[n] = bits;
+    }
+    return res;
+}
+
+std::vector<z3::expr> SimplifierThread::GetOwnResult(z3::context& c) const
+{
+    if (!exported)
+        return Translate(result, c);
+
+    std::vector<z3::expr> res;
+    for (auto id : result_ids)
+        res.push_back(result_ir.Build(id, c));
+    return res;
+}
+
+void SimplifierThread::BuildExpr()
+{
+    if (!ir)
         return;
-        
+
+    TraceScope trace("BuildFromIR");
+    // the finished inner jobs spare this one building their BDDs again
+    std::unordered_map<FormulaIR::NodeId, z3::expr> replaced;
+    for (const auto* inner : summary_sources)
+    {
+        if (auto summary = inner->GetSummary(*ctx))
+            replaced.emplace(inner->ir_root, *summary);
+    }
+    job_stats.summaries = replaced.size();
+    trace.AddArg("summaries", (long long)replaced.size());
+    expr = ir->Build(ir_root, *ctx, std::move(replaced));
+    for (auto b : ir_bound)
+        pre_bound.push_back(ir->Build(b, *ctx));
+}
+
+void SimplifierThread::Prepare()
+{
+    {
+        TraceScope trace("CollectVars");
+        expr = CollectVars(expr, 0);
+    }
+
+    {
+        TraceScope trace("ExprToBDDTransformer");
+        transformer = std::make_unique<ExprToBDDTransformer>(expr.ctx(), expr, Config());
+    }
+
     if (!overapproximate)
         transformer->setApproximationType(ZERO_EXTEND);
+    transformer->existentialFastPath = existential_fast_path;
+
+    // stops the BDD operations inside Q3B as soon as the results are not needed
+    Cudd_RegisterTerminationCallback(transformer->bddManager.getManager(), [](const void* arg) {
+        return (int)static_cast<const SimplifierThread*>(arg)->Stopped();
+    }, (void*)this);
+}
+
+BDD SimplifierThread::Approximate(int bw, int prec)
+{
+    if (overapproximate)
+        return transformer->ProcessOverapproximation(bw, prec).upper;
+    return transformer->ProcessUnderapproximation(bw, prec).lower;
+}
+
+void SimplifierThread::CollectStats()
+{
+    job_stats.finished = completed;
+    job_stats.minimized = minimized;
+    job_stats.dropped = dropped;
+    if (!transformer)
+        return;
+
+    DdManager* mgr = transformer->bddManager.getManager();
+    job_stats.peak_live_nodes = Cudd_ReadPeakLiveNodeCount(mgr);
+    job_stats.gc_ms = Cudd_ReadGarbageCollectionTime(mgr);
+    job_stats.reorder_ms = Cudd_ReadReorderingTime(mgr);
+    double lookups = Cudd_ReadCacheLookUps(mgr);
+    job_stats.cache_hit_rate = lookups > 0 ? Cudd_ReadCacheHits(mgr) / lookups : 0;
+}
+
+bool SimplifierThread::RunRound()
+{
+    if (Stopped() || current_bw > 128)
+        return false;
 
     std::string approx_str = overapproximate ? "over" : "under";
 
-    int bw = 1;
-    int prec = 1;
-    std::vector<int> node_counts;
-    node_counts.push_back(0);
-    while (bw <= 128)
+    int bw = current_bw;
+    int prec = current_prec;
+    // logger.Log("Running expr to bdd (over = " + std::to_string(overapproximate) +
+    //             "; bw = " + std::to_string(bw) + "; prec = " + std::to_string(prec) + ")...");
+    TraceScope round_trace(overapproximate ? "ProcessOverapproximation" : "ProcessUnderapproximation");
+    round_trace.AddArg("bw", bw);
+    round_trace.AddArg("prec", prec);
+    BDD bdd = Approximate(bw, prec);
+    if (Stopped())
+        return false;
+    round_trace.AddArg("nodes", bdd.nodeCount());
+    round_trace.End();
+
+    job_stats.rounds++;
+    job_stats.final_bw = bw;
+    job_stats.final_prec = prec;
+    if (job_stats.node_counts.empty() || job_stats.node_counts.back() != (int)bdd.nodeCount())
+        ++progress;
+    job_stats.node_counts.push_back(bdd.nodeCount());
+    // logger.DumpFormulaBDD(expr, bdd.upper);
+
+    if ((overapproximate && bdd.IsZero()) || (!overapproximate && bdd.IsOne()))
+        return SetDecided(bw);
+
+    int nc = bdd.nodeCount();
+    if (nc != result_node_counts.back() && !bdd.IsZero() && !bdd.IsOne())
     {
-        // logger.Log("Running expr to bdd (over = " + std::to_string(overapproximate) +
-        //             "; bw = " + std::to_string(bw) + "; prec = " + std::to_string(prec) + ")...");
-        BDDInterval bdds;
-        if (overapproximate)
-            bdds = transformer->ProcessOverapproximation(bw, prec);
-        else
-            bdds = transformer->ProcessUnderapproximation(bw, prec);
-        if (Solver::resultComputed)
-            return;
-        const auto& bdd = overapproximate ? bdds.upper : bdds.lower;
-        // logger.DumpFormulaBDD(expr, bdd.upper);
-
-        if (overapproximate && bdd.IsZero())
+        BDD own = overapproximate ? bdd : bdd & FixUnderBDD(bw);
+        // what the new approximation and the last result describe together,
+        // only compared with the last result when minimizing against it
+        bool use_prev = settings.minimize && prev_approx;
+        BDD combined = !use_prev ? own : overapproximate ? own & *prev_approx : own | *prev_approx;
+        BDD small = MinimizeBDD(bdd);
+        int small_nc = small.nodeCount();
+        logger.Log("Useful result returned (" + std::to_string(nc) + " nodes, " + std::to_string(small_nc) + " minimized) " + approx_str + " " + std::to_string(bw) + " " + std::to_string(prec));
+        if (use_prev && (overapproximate ? combined.IsZero() : combined == FixUnderBDD(bw)))
         {
-            logger.Log("Bdd always false");
-            result.clear();
-            result.push_back(expr.ctx().bool_val(false));
-            return;
+            logger.Log("Decided together with the previous approximation");
+            return SetDecided(bw);
         }
-        if (!overapproximate && bdd.IsOne())
+        if (use_prev && combined == *prev_approx)
         {
-            logger.Log("Bdd always true");
-            result.clear();
-            auto cand = FixUnder(expr.ctx().bool_val(true), bw);
-            assert(!isFalse(cand));
-            result.push_back(cand);
-            return;
+            logger.Log("Result subsumed by the previous approximation");
         }
-
-        int nc = bdd.nodeCount();
-        if (nc != node_counts.back() && !bdd.IsZero() && !bdd.IsOne())
+        else if (settings.max_approx_nodes && small_nc > settings.max_approx_nodes)
+        {
+            logger.Log("Result dropped, over the node budget");
+            ++dropped;
+        }
+        else
         {
-            logger.Log("Useful result returned (" + std::to_string(bdd.nodeCount()) + " nodes) " + approx_str + " " + std::to_string(bw) + " " + std::to_string(prec));
-            auto cand = BDDToFormula(bdd);
-            // auto cand = BDDToFormulaApprox(bdd, 5);
+            auto cand = ConvertBDD(small);
             // logger.DumpFormulaBDD(cand, bdd);
             if (!overapproximate)
+            {
+                TraceScope trace("FixUnder");
                 cand = FixUnder(cand, bw);
-            if (Solver::resultComputed)
-                return;
-            while (nc < node_counts.back())
+            }
+            if (Stopped())
+                return false;
+            // the minimized approximation is only as precise as the new one
+            // together with the last result, which may be popped below or
+            // left out by PickResults, so the result includes it
+            if (small != bdd)
             {
-                node_counts.pop_back();
+                assert(!result.empty());
+                auto last = result.back();
+                cand = overapproximate ? simplifyAnd(cand.ctx(), {cand, last}) : simplifyOr(cand.ctx(), {cand, last});
+            }
+            while (nc < result_node_counts.back())
+            {
+                result_node_counts.pop_back();
                 result.pop_back();
             }
-            node_counts.push_back(nc);
+            result_node_counts.push_back(nc);
             assert(!isFalse(cand) && !isTrue(cand));
             result.push_back(cand);
+            result_bw = bw;
+            job_stats.approx_sizes.push_back(formulaSize(cand));
+            // the care set of the next minimization is what the new result describes
+            prev_approx = small != bdd ? combined : own;
+            if (want_model && !overapproximate && !prev_approx->IsZero())
+                model = ExtractModel(*prev_approx);
         }
+    }
 
-        if (transformer->OperationApproximationHappened())
-            prec *= 4;
-        else if (bw == 1)
-            bw = 2;
-        else
-            bw += 2;
+    if (transformer->OperationApproximationHappened())
+        current_prec = prec * 4;
+    else if (bw == 1)
+        current_bw = 2;
+    else
+        current_bw = bw + 2;
+    return current_bw <= 128;
+}
+
+bool SimplifierThread::SetDecided(int bw)
+{
+    result.clear();
+    result_bw = INT_MAX;
+    if (overapproximate)
+    {
+        logger.Log("Bdd always false");
+        (origin ? origin : this)->refuted = true;
+        result.push_back(expr.ctx().bool_val(false));
+        return false;
     }
 
-    logger.Log("Done");
+    logger.Log("Bdd always true");
+    auto cand = FixUnder(expr.ctx().bool_val(true), bw);
+    assert(!isFalse(cand));
+    if (want_model)
+        model = ExtractModel(FixUnderBDD(bw));
+    result.push_back(cand);
+    return false;
+}
+
+BDD SimplifierThread::MinimizeBDD(const BDD& bdd)
+{
+    if (!settings.minimize || !prev_approx)
+        return bdd;
+
+    TraceScope trace("MinimizeBDD");
+    trace.AddArg("nodes", bdd.nodeCount());
+
+    // Any function that agrees with the new approximation on the care set is
+    // still sound: over-approximations only matter inside the previous
+    // over-approximation, under-approximations only outside the previous one.
+    BDD care = overapproximate ? *prev_approx : !*prev_approx;
+    if (care.IsZero())
+        return bdd;
+
+    BDD best = bdd;
+    for (const BDD& cand : {bdd.Restrict(care), bdd.LICompaction(care)})
+    {
+        if (cand.nodeCount() < best.nodeCount())
+            best = cand;
+    }
+    if (best != bdd)
+        ++minimized;
+    return best;
 }
 
 z3::expr SimplifierThread::BDDToFormula(DdNode* node)
@@ -134,10 +513,10 @@ z3::expr SimplifierThread::BDDToFormula(DdNode* node)
         return expr_cache.at(node);
 
     z3::expr texpr = BDDToFormula(Cudd_Regular(Cudd_T(node)));
-    if (Solver::resultComputed)
+    if (Stopped())
         return expr.ctx().bool_val(false);
     z3::expr fexpr = BDDToFormula(Cudd_Regular(Cudd_E(node)));
-    if (Solver::resultComputed)
+    if (Stopped())
         return expr.ctx().bool_val(false);
 
     if (Cudd_IsComplement(Cudd_E(node)))
@@ -157,20 +536,12 @@ z3::expr SimplifierThread::BDDToFormula(DdNode* node)
 z3::expr SimplifierThread::BDDToFormula(const BDD& bdd)
 {
     expr_cache.clear();
-    idx_to_var.clear();
-    for (const auto&[name, bvec] : transformer->vars)
-    {
-        for (int i = 0; i < bvec.bitnum(); ++i)
-        {
-            int idx = bvec[i].GetBDD().NodeReadIndex();
-            idx_to_var[idx] = std::make_pair(name, i);
-        }
-    }
+    BuildIndexMap();
     expr_cache.emplace(Cudd_ReadOne(bdd.manager()), expr.ctx().bool_val(true));
     expr_cache.emplace(Cudd_ReadZero(bdd.manager()), expr.ctx().bool_val(false));
 
     auto ne = BDDToFormula(bdd.getRegularNode());
-    if (Solver::resultComputed)
+    if (Stopped())
         return expr.ctx().bool_val(false);
 
     if (Cudd_IsComplement(bdd.getNode()))
@@ -179,16 +550,49 @@ z3::expr SimplifierThread::BDDToFormula(const BDD& bdd)
     return ne;
 }
 
+z3::expr SimplifierThread::BDDToFormulaWord(const BDD& bdd)
+{
+    BuildIndexMap();
+    WordEncoder encoder(transformer->bddManager, expr.ctx(), vars, idx_to_var, stop);
+    return encoder.Encode(bdd);
+}
+
+z3::expr SimplifierThread::ConvertBDD(const BDD& bdd)
+{
+    TraceScope trace("BDDToFormula");
+    trace.AddArg("nodes", bdd.nodeCount());
+    if (settings.encoding == Encoding::WORD)
+        return BDDToFormulaWord(bdd);
+    if (settings.encoding == Encoding::DNF)
+        return BDDToFormulaApprox(bdd, settings.dnf_k);
+    return BDDToFormula(bdd);
+}
+
+void SimplifierThread::BuildIndexMap()
+{
+    idx_to_var.clear();
+    for (const auto&[name, bvec] : transformer->vars)
+    {
+        for (int i = 0; i < bvec.bitnum(); ++i)
+        {
+            BDD bit = bvec[i].GetBDD();
+            if (bit.IsZero() || bit.IsOne())
+                continue;
+            idx_to_var[bit.NodeReadIndex()] = std::make_pair(name, i);
+        }
+    }
+}
+
 ApproxExpr SimplifierThread::BDDToFormulaApprox(DdNode *node, std::size_t max_size)
 {
     if (approx_expr_cache.find(node) != approx_expr_cache.end())
         return approx_expr_cache.at(node);
 
     const auto& texpr = BDDToFormulaApprox(Cudd_Regular(Cudd_T(node)), max_size);
-    if (Solver::resultComputed)
+    if (Stopped())
         return ApproxExpr(expr.ctx());
     const auto& fexpr = BDDToFormulaApprox(Cudd_Regular(Cudd_E(node)), max_size);
-    if (Solver::resultComputed)
+    if (Stopped())
         return ApproxExpr(expr.ctx());
 
     auto fpo = Cudd_IsComplement(Cudd_E(node)) ? fexpr.pths_zero : fexpr.pths_one;
@@ -215,15 +619,7 @@ ApproxExpr SimplifierThread::BDDToFormulaApprox(DdNode *node, std::size_t max_si
 z3::expr SimplifierThread::BDDToFormulaApprox(const BDD &bdd, std::size_t max_size)
 {
     approx_expr_cache.clear();
-    idx_to_var.clear();
-    for (const auto&[name, bvec] : transformer->vars)
-    {
-        for (int i = 0; i < bvec.bitnum(); ++i)
-        {
-            int idx = bvec[i].GetBDD().NodeReadIndex();
-            idx_to_var[idx] = std::make_pair(name, i);
-        }
-    }
+    BuildIndexMap();
     ApproxExpr false_expr(expr.ctx());
     ApproxExpr true_expr(expr.ctx());
     false_expr.pths_zero.clauses.emplace_back();
@@ -232,7 +628,7 @@ z3::expr SimplifierThread::BDDToFormulaApprox(const BDD &bdd, std::size_t max_si
     approx_expr_cache.emplace(Cudd_ReadZero(bdd.manager()), false_expr);
 
     const auto& ne = BDDToFormulaApprox(bdd.getRegularNode(), max_size);
-    if (Solver::resultComputed)
+    if (Stopped())
         return expr.ctx().bool_val(false);
 
     const auto& po = Cudd_IsComplement(bdd.getNode()) ? ne.pths_zero : ne.pths_one;
@@ -245,7 +641,7 @@ z3::expr SimplifierThread::BDDToFormulaApprox(const BDD &bdd, std::size_t max_si
 
 z3::expr SimplifierThread::CollectVars(z3::expr e, int n_bound)
 {
-    if (Solver::resultComputed)
+    if (Stopped())
         return e;
 
     if (e.is_var())
@@ -310,26 +706,58 @@ z3::expr SimplifierThread::FixUnder(z3::expr e, int bw)
     return simplifyAnd(e.ctx(), conj);
 }
 
+BDD SimplifierThread::FixUnderBDD(int bw)
+{
+    BDD res = transformer->bddManager.bddOne();
+    for (auto&[n, v] : vars)
+    {
+        auto sort = v.get_sort();
+        if (sort.is_bool())
+            continue;
+        int bits = sort.bv_size();
+        if (bits <= bw)
+            continue;
+        const auto& bvec = transformer->vars.at(n);
+        int lo_bit = (bw + 1) / 2;
+        int hi_bit = bits - 1 - bw / 2;
+        for (int i = lo_bit; i <= hi_bit; ++i)
+            res &= !bvec[i].GetBDD();
+    }
+    return res;
+}
+
 z3::expr ApproxDNF::ToFormula() const
 {
     std::vector<z3::expr> clause_formulas;
     for (const auto& c : clauses)
-        clause_formulas.push_back(simplifyAnd(*ctx, c));
+    {
+        std::vector<z3::expr> lits;
+        for (const ClauseNode* n = c.get(); n; n = n->next.get())
+            lits.push_back(n->lit);
+        clause_formulas.push_back(simplifyAnd(*ctx, lits));
+    }
     return simplifyOr(*ctx, clause_formulas);
 }
 
 void ApproxDNF::AddConstraint(z3::expr e)
 {
     for (auto& c : clauses)
-        c.push_back(e);
+        c = std::make_shared<const ClauseNode>(ClauseNode{e, c, ClauseSize(c) + 1});
 }
 
-ApproxDNF ApproxDNF::MergeWith(const ApproxDNF &other, std::size_t max_size)
+ApproxDNF ApproxDNF::MergeWith(const ApproxDNF &other, std::size_t max_size) const
 {
     assert(ctx == other.ctx);
     ApproxDNF res(*ctx);
-    std::merge(clauses.begin(), clauses.end(), other.clauses.begin(), other.clauses.end(), std::back_inserter(res.clauses), [&](const auto& a, const auto& b) { return a.size() < b.size(); });
-    if (res.clauses.size() > max_size)
-        res.clauses.resize(max_size);
+    res.clauses.reserve(std::min(max_size, clauses.size() + other.clauses.size()));
+    auto a = clauses.begin();
+    auto b = other.clauses.begin();
+    while (res.clauses.size() < max_size && (a != clauses.end() || b != other.clauses.end()))
+    {
+        if (b == other.clauses.end() || (a != clauses.end() && ClauseSize(*a) <= ClauseSize(*b)))
+            res.clauses.push_back(*a++);
+        else
+            res.clauses.push_back(*b++);
+    }
     return res;
 }
@@ -1,28 +1,50 @@
 #pragma once
 #include <map>
-#include <thread>
+#include <atomic>
 #include <memory>
+#include <optional>
 #include <z3++.h>
 #include "ExprToBDDTransformer.h"
 #include "Config.h"
 #include "FBSLogger.h"
+#include "FBSStats.h"
+#include "FBSTracer.h"
+#include "Settings.h"
+#include "FormulaIR.h"
+#include "TimeoutManager.h"
+#include "Model.h"
 
 z3::expr Translate(z3::expr e, z3::context& ctx);
 std::vector<z3::expr> Translate(const std::vector<z3::expr>& es, z3::context& ctx);
 z3::expr_vector GetQuantBoundVars(z3::expr e);
 
+// Clause of an ApproxDNF stored as a list of literals. Clauses that differ
+// only in their first literals share the common tail, so extending every
+// clause of a node by one literal costs one list node per clause.
+struct ClauseNode
+{
+    z3::expr lit;
+    std::shared_ptr<const ClauseNode> next;
+    std::size_t size;
+};
+
+using Clause = std::shared_ptr<const ClauseNode>;
+
 struct ApproxDNF
 {
     ApproxDNF(z3::context& c) : ctx(&c) {}
 
     z3::context* ctx;
-    std::vector<std::vector<z3::expr>> clauses;
+    // sorted by size, the empty clause is nullptr
+    std::vector<Clause> clauses;
 
     z3::expr ToFormula() const;
 
     void AddConstraint(z3::expr e);
 
-    ApproxDNF MergeWith(const ApproxDNF& other, std::size_t max_size);
+    ApproxDNF MergeWith(const ApproxDNF& other, std::size_t max_size) const;
+
+    static std::size_t ClauseSize(const Clause& c) { return c ? c->size : 0; }
 };
 
 struct ApproxExpr
@@ -33,45 +55,198 @@ struct ApproxExpr
     ApproxDNF pths_zero;
 };
 
+// State of one FormulaSimplifier shared with its jobs.
+struct SimplifierEnv
+{
+    const Settings& settings;
+    FBSLogger& logger;
+    // set when the results are no longer needed, the jobs stop as soon as possible
+    const std::atomic<bool>& stop;
+    // budget of the jobs, ends before the one of the simplifier
+    const TimeoutManager& budget;
+    FBSTracer* tracer;
+    // context of the simplified formula, jobs built from the IR only use it
+    // for their expressions until they are built
+    z3::context& ctx;
+};
+
+// One approximation job of a quantified subformula. Jobs are run by the
+// worker threads of their FormulaSimplifier.
 class SimplifierThread
 {
 public:
-    SimplifierThread(SimplifierThread&&) = default;
-    SimplifierThread(z3::expr e, bool over, const std::vector<z3::expr>& bnd) : overapproximate(over), expr(Translate(e, ctx)), pre_bound(Translate(bnd, ctx)), thread([this] { Run(); }) 
+    SimplifierThread(const SimplifierEnv& env, z3::expr e, bool over, const std::vector<z3::expr>& bnd)
+        : settings(env.settings), logger(env.logger), stop(env.stop), budget(env.budget), tracer(env.tracer), overapproximate(over),
+          own_ctx(std::make_unique<z3::context>()), ctx(own_ctx.get()), expr(Translate(e, *ctx)), pre_bound(Translate(bnd, *ctx)) {}
+
+    // the subformula and the bound variables are rebuilt from the IR by the
+    // job itself in the context of its worker, the IR has to outlive the job
+    SimplifierThread(const SimplifierEnv& env, const FormulaIR& ir, FormulaIR::NodeId root, bool over, const std::vector<FormulaIR::NodeId>& bnd)
+        : settings(env.settings), logger(env.logger), stop(env.stop), budget(env.budget), tracer(env.tracer), overapproximate(over), expr(env.ctx), ir(&ir), ir_root(root), ir_bound(bnd) {}
+
+    // speculative run of the IR job `orig` starting at a higher bit-width,
+    // the first run of the two that finishes cancels the other one
+    SimplifierThread(const SimplifierEnv& env, SimplifierThread& orig, int bw, int prec)
+        : SimplifierThread(env, *orig.ir, orig.ir_root, orig.overapproximate, orig.ir_bound)
     {
+        origin = &orig;
+        want_model = orig.want_model;
+        existential_fast_path = orig.existential_fast_path;
+        summary_sources = orig.summary_sources;
+        start_bw = current_bw = bw;
+        start_prec = current_prec = prec;
     }
 
-    void Run();
-    void RunApprox();
+    // `worker_ctx` is used by the jobs built from the IR, it may be shared
+    // with other jobs of the same worker
+    void Run(z3::context& worker_ctx);
+
+    // Run split into resumable steps: Start prepares the job, every Step
+    // runs one refinement round and returns whether more rounds are left,
+    // Finish releases the job. A job may move between threads between the
+    // steps, but then it needs a context of its own.
+    bool Start(z3::context& worker_ctx);
+    bool Step();
+    void Finish();
+
+    void BuildExpr();
+    void Prepare();
 
-    void WaitForResult() { thread.join(); }
+    BDD Approximate(int bw, int prec);
 
     bool IsFinished() const { return finished; }
+    // an over-approximation of the subformula was false
+    bool IsRefuted() const { return refuted; }
+    bool Stopped() const { return stop || (origin ? origin->cancelled : cancelled); }
+
+    // whether an idle worker may start a speculative run of this job,
+    // the speculations are registered by the simplifier under its lock
+    bool CanSpeculate() const { return ir && !origin && started && !finished && !Stopped(); }
+    std::size_t GetSpeculationCount() const { return speculations.size(); }
+    void AddSpeculation(SimplifierThread* s) { speculations.push_back(s); }
+    int GetCurrentBw() const { return current_bw; }
+    int GetCurrentPrec() const { return current_prec; }
+    int GetRounds() const { return job_stats.rounds; }
+    // rounds that changed the approximation so far
+    int GetProgress() const { return progress; }
+    // change of the BDD size per second in the last round
+    double GetGainRate() const { return gain_rate; }
 
     z3::expr BDDToFormula(DdNode* node);
     z3::expr BDDToFormula(const BDD& bdd);
 
+    z3::expr BDDToFormulaWord(const BDD& bdd);
+
+    z3::expr ConvertBDD(const BDD& bdd);
+
     ApproxExpr BDDToFormulaApprox(DdNode* node, std::size_t max_size);
     z3::expr BDDToFormulaApprox(const BDD& bdd, std::size_t max_size);
 
     z3::expr CollectVars(z3::expr e, int n_bound);
 
-    const std::vector<z3::expr>& GetResult() const { return result; }
+    // the results in `ctx` together with the ones of the speculative run
+    // that got furthest, only called once all runs are finished
+    std::vector<z3::expr> GetResult(z3::context& ctx) const;
+
+    // under-approximations keep a model of their last approximation, the
+    // model of a run that got furthest is returned like in GetResult
+    void RequestModel() { want_model = true; }
+    // lets Q3B treat the outer existential variables like free ones; only
+    // sound for jobs whose result is only used to decide the formula
+    void EnableExistentialFastPath() { existential_fast_path = true; }
+
+    // a job of an inner quantifier whose approximation replaces it in the
+    // subformula of this job, if the job is finished when this one starts
+    void AddSummarySource(const SimplifierThread* inner) { summary_sources.push_back(inner); }
+    // the approximations of a finished IR job as one formula in `c`, with
+    // the bound variables around its subformula as de Bruijn variables
+    std::optional<z3::expr> GetSummary(z3::context& c) const;
+    std::optional<Model> GetModel() const;
+
+    int GetDroppedCount() const { return dropped; }
+    bool HasResult() const { return result_bw > 0; }
+
+    const JobStats& GetStats() const { return job_stats; }
+    void SetPrediction(double seconds) { job_stats.predicted_seconds = seconds; }
+
+    const z3::expr& GetExpr() const { return expr; }
 
     z3::expr FixUnder(z3::expr e, int bw);
+    BDD FixUnderBDD(int bw);
+
+    BDD MinimizeBDD(const BDD& bdd);
 
 private:
+    const Settings& settings;
+    FBSLogger& logger;
+    const std::atomic<bool>& stop;
+    // no round is started after it
+    TimeoutManager budget;
+    FBSTracer* tracer;
+
     bool overapproximate;
-    z3::context ctx;
+    // only set for the jobs translated directly
+    std::unique_ptr<z3::context> own_ctx;
+    z3::context* ctx = nullptr;
     z3::expr expr;
     std::vector<z3::expr> pre_bound;
     std::vector<z3::expr> result;
-    bool finished = false;
+
+    // results of a finished job, all its terms are released by then
+    FormulaIR result_ir;
+    std::vector<FormulaIR::NodeId> result_ids;
+    bool exported = false;
+
+    const FormulaIR* ir = nullptr;
+    FormulaIR::NodeId ir_root = 0;
+    std::vector<FormulaIR::NodeId> ir_bound;
+    std::atomic<bool> started = false;
+    std::atomic<bool> finished = false;
+
+    SimplifierThread* origin = nullptr;
+    std::vector<SimplifierThread*> speculations;
+    // set once one run of the job completes, the other runs are useless then
+    std::atomic<bool> cancelled = false;
+    // set on the original job by any of its runs
+    std::atomic<bool> refuted = false;
+    bool completed = false;
+    int start_bw = 1;
+    int start_prec = 1;
+    std::atomic<int> current_bw = 1;
+    std::atomic<int> current_prec = 1;
+    // bit-width of the last result, INT_MAX for exact ones
+    int result_bw = 0;
+    // BDD sizes of the approximations in `result`
+    std::vector<int> result_node_counts = {0};
+    double gain_rate = 0;
+    std::atomic<int> progress = 0;
 
     std::unique_ptr<ExprToBDDTransformer> transformer;
-    std::thread thread;
 
     int nodes = 0;
+    int minimized = 0;
+    int dropped = 0;
+
+    std::optional<BDD> prev_approx;
+
+    JobStats job_stats;
+
+    bool want_model = false;
+    bool existential_fast_path = false;
+    std::vector<const SimplifierThread*> summary_sources;
+    std::optional<Model> model;
+
+    bool RunRound();
+    // the approximation decides the quantifier, it replaces all results
+    bool SetDecided(int bw);
+    Model ExtractModel(const BDD& bdd);
+    void CollectStats();
+    void Reset();
+    void ExportResult();
+    std::vector<z3::expr> GetOwnResult(z3::context& ctx) const;
+    std::string JobName() const;
+
+    void BuildIndexMap();
 
     std::map<std::string, z3::expr> vars;
     std::map<const DdNode*, z3::expr> expr_cache;
@@ -1,3 +0,0 @@
-#include "TimeoutManager.h"
-
-TimeoutManager time_manager;
\ No newline at end of file
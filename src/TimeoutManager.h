@@ -1,20 +1,52 @@
 #pragma once
 #include <chrono>
 #include <thread>
+#include <optional>
+#include <algorithm>
 
+// Time budget ending at a steady-clock deadline. Budgets of the parts of a
+// run are derived from the budget of the whole run; since they all end at
+// absolute deadlines, time a part does not use stays available to the
+// parts after it.
 class TimeoutManager
 {
 public:
-    TimeoutManager() { start_tp = std::chrono::high_resolution_clock::now(); }
+    using clck = std::chrono::steady_clock;
 
-    void SetTimeout(int seconds) { timeout_seconds = seconds; }
+    TimeoutManager() { start_tp = clck::now(); }
 
-    bool IsTimeout() const { return timeout_seconds != 0 && std::chrono::high_resolution_clock::now() >= start_tp + std::chrono::seconds(timeout_seconds); }
+    void SetTimeout(int seconds) { SetTimeoutMs(seconds * 1000); }
+    // counted from the creation of the manager, 0 for no timeout
+    void SetTimeoutMs(int ms)
+    {
+        if (ms == 0)
+            deadline.reset();
+        else
+            deadline = start_tp + std::chrono::milliseconds(ms);
+    }
 
-private:
-    std::chrono::high_resolution_clock::time_point start_tp;
-    int timeout_seconds = 0;
-};
+    bool IsTimeout() const { return deadline && clck::now() >= *deadline; }
+
+    // time left until the timeout in ms (at least 1), 0 if there is no timeout
+    int RemainingMs() const
+    {
+        if (!deadline)
+            return 0;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - clck::now()).count();
+        return std::max(1, (int)left);
+    }
 
-extern TimeoutManager time_manager;
+    // budget of the work that has to end `tail_ms` before this budget, so
+    // that the tail is left for the work after it
+    TimeoutManager WithoutTail(int tail_ms) const
+    {
+        TimeoutManager res = *this;
+        if (deadline)
+            res.deadline = std::max(clck::now(), *deadline - std::chrono::milliseconds(tail_ms));
+        return res;
+    }
 
+private:
+    clck::time_point start_tp;
+    std::optional<clck::time_point> deadline;
+};
@@ -0,0 +1,372 @@
+#include <set>
+#include <tuple>
+#include <cassert>
+#include <algorithm>
+
+#include "WordEncoder.h"
+#include "SimplifierBasic.h"
+
+WordEncoder::WordEncoder(Cudd& manager, z3::context& ctx, const std::map<std::string, z3::expr>& vars, const std::map<int, std::pair<std::string, int>>& idx_to_var, const std::atomic<bool>& stop)
+    : mgr(manager), ctx(ctx), idx_to_var(idx_to_var), stop(stop)
+{
+    for (const auto&[idx, var_bit] : idx_to_var)
+    {
+        const auto&[name, bit] = var_bit;
+        auto var = vars.find(name);
+        if (var == vars.end())
+            continue;
+
+        auto wv = word_vars.find(name);
+        if (wv == word_vars.end())
+        {
+            int width = var->second.is_bool() ? 0 : (int)var->second.get_sort().bv_size();
+            wv = word_vars.emplace(name, WordVar{var->second, width, std::vector<int>(std::max(width, 1), -1)}).first;
+        }
+        wv->second.bit_idx[bit] = idx;
+    }
+}
+
+z3::expr WordEncoder::Encode(const BDD& bdd)
+{
+    if (bdd.IsOne())
+        return ctx.bool_val(true);
+    if (bdd.IsZero())
+        return ctx.bool_val(false);
+
+    auto it = cache.find(bdd.getNode());
+    if (it != cache.end())
+        return it->second.second;
+
+    if (stop)
+        return ctx.bool_val(false);
+
+    z3::expr res = EncodeNode(bdd);
+    cache.emplace(bdd.getNode(), std::make_pair(bdd, res));
+    return res;
+}
+
+z3::expr WordEncoder::EncodeNode(const BDD& f)
+{
+    if (f.nodeCount() > max_analysed_nodes)
+        return EncodeIte(f);
+
+    auto support = SupportVars(f);
+    if (support.size() == 1)
+    {
+        auto wv = word_vars.find(support[0]);
+        if (wv != word_vars.end())
+        {
+            auto res = EncodeSingle(wv->second, f);
+            if (res)
+                return *res;
+        }
+    }
+
+    BDD essential = f.FindEssential();
+    if (!essential.IsOne())
+        return simplifyAnd(ctx, {EncodeCube(essential), Encode(f.Cofactor(essential))});
+
+    if (auto res = EncodeEquality(support, f))
+        return *res;
+
+    if (auto res = EncodeDecomposition(support, f))
+        return *res;
+
+    return EncodeIte(f);
+}
+
+z3::expr WordEncoder::EncodeIte(const BDD& f)
+{
+    int idx = f.NodeReadIndex();
+    BDD b = mgr.bddVar(idx);
+
+    z3::expr texpr = Encode(f.Cofactor(b));
+    if (stop)
+        return ctx.bool_val(false);
+    z3::expr fexpr = Encode(f.Cofactor(!b));
+
+    return simplifyIte(BitTest(idx), texpr, fexpr);
+}
+
+z3::expr WordEncoder::EncodeCube(const BDD& cube)
+{
+    std::map<std::string, std::vector<std::pair<int, bool>>> lits;
+    BDD rest = cube;
+    while (!rest.IsOne())
+    {
+        int idx = rest.NodeReadIndex();
+        BDD b = mgr.bddVar(idx);
+        BDD pos = rest.Cofactor(b);
+        const auto&[name, bit] = idx_to_var.at(idx);
+        lits[name].emplace_back(bit, !pos.IsZero());
+        rest = pos.IsZero() ? rest.Cofactor(!b) : pos;
+    }
+
+    std::vector<z3::expr> atoms;
+    for (auto&[name, bits] : lits)
+    {
+        const auto& v = word_vars.at(name);
+        if (v.width == 0)
+        {
+            atoms.push_back(bits[0].second ? v.expr : !v.expr);
+        }
+        else if (v.width <= 64)
+        {
+            uint64_t mask = 0, val = 0;
+            for (const auto&[bit, value] : bits)
+            {
+                mask |= 1ULL << bit;
+                if (value)
+                    val |= 1ULL << bit;
+            }
+            atoms.push_back(MaskedToFormula(v, mask, val));
+        }
+        else
+        {
+            // too wide for a 64-bit mask, fix runs of consecutive bits instead
+            std::sort(bits.begin(), bits.end());
+            std::size_t i = 0;
+            while (i < bits.size())
+            {
+                std::size_t j = i;
+                uint64_t val = 0;
+                while (j < bits.size() && bits[j].first == bits[i].first + (int)(j - i) && j - i < 64)
+                {
+                    if (bits[j].second)
+                        val |= 1ULL << (j - i);
+                    ++j;
+                }
+                int lo = bits[i].first;
+                int hi = bits[j - 1].first;
+                atoms.push_back(v.expr.extract(hi, lo) == ctx.bv_val(val, hi - lo + 1));
+                i = j;
+            }
+        }
+    }
+    return simplifyAnd(ctx, atoms);
+}
+
+std::optional<z3::expr> WordEncoder::EncodeSingle(const WordVar& v, const BDD& f)
+{
+    if (v.width == 0)
+        return f == mgr.bddVar(v.bit_idx[0]) ? v.expr : !v.expr;
+
+    if (v.width > 64)
+        return std::nullopt;
+
+    std::vector<Interval> pos_intervals, neg_intervals;
+    std::vector<Cube> pos_cubes, neg_cubes;
+    bool pos_intervals_ok = CollectIntervals(v, f, v.width - 1, 0, pos_intervals);
+    bool neg_intervals_ok = CollectIntervals(v, !f, v.width - 1, 0, neg_intervals);
+    bool pos_cubes_ok = CollectCubes(f, 0, 0, pos_cubes);
+    bool neg_cubes_ok = CollectCubes(!f, 0, 0, neg_cubes);
+
+    auto interval_atoms = [&](const std::vector<Interval>& in)
+    {
+        std::size_t atoms = 0;
+        for (const auto&[lo, hi] : in)
+            atoms += (lo == hi || lo == 0 || hi == FullMask(v.width)) ? 1 : 2;
+        return atoms;
+    };
+
+    // (atoms, negated, use intervals)
+    std::vector<std::tuple<std::size_t, bool, bool>> options;
+    if (pos_intervals_ok)
+        options.emplace_back(interval_atoms(pos_intervals), false, true);
+    if (neg_intervals_ok)
+        options.emplace_back(interval_atoms(neg_intervals), true, true);
+    if (pos_cubes_ok)
+        options.emplace_back(pos_cubes.size(), false, false);
+    if (neg_cubes_ok)
+        options.emplace_back(neg_cubes.size(), true, false);
+    if (options.empty())
+        return std::nullopt;
+
+    auto[atoms, negated, intervals] = *std::min_element(options.begin(), options.end(), [](const auto& a, const auto& b) { return std::get<0>(a) < std::get<0>(b); });
+    if (atoms > max_atoms)
+        return std::nullopt;
+
+    std::vector<z3::expr> disj;
+    if (intervals)
+    {
+        for (const auto& in : negated ? neg_intervals : pos_intervals)
+            disj.push_back(IntervalToFormula(v, in));
+    }
+    else
+    {
+        for (const auto&[mask, val] : negated ? neg_cubes : pos_cubes)
+            disj.push_back(MaskedToFormula(v, mask, val));
+    }
+
+    auto res = simplifyOr(ctx, disj);
+    return negated ? simplifyNot(res) : res;
+}
+
+std::optional<z3::expr> WordEncoder::EncodeEquality(const std::vector<std::string>& support, const BDD& f)
+{
+    for (std::size_t i = 0; i < support.size(); ++i)
+    {
+        for (std::size_t j = i + 1; j < support.size(); ++j)
+        {
+            auto a = word_vars.find(support[i]);
+            auto b = word_vars.find(support[j]);
+            if (a == word_vars.end() || b == word_vars.end() || a->second.width != b->second.width)
+                continue;
+
+            const auto& abits = a->second.bit_idx;
+            const auto& bbits = b->second.bit_idx;
+            if (std::count(abits.begin(), abits.end(), -1) || std::count(bbits.begin(), bbits.end(), -1))
+                continue;
+
+            BDD eq = mgr.bddOne();
+            for (std::size_t k = 0; k < abits.size(); ++k)
+                eq &= mgr.bddVar(abits[k]).Xnor(mgr.bddVar(bbits[k]));
+
+            if (f.Leq(eq))
+                return simplifyAnd(ctx, {a->second.expr == b->second.expr, Encode(f.ExistAbstract(VarsCube({support[j]})))});
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<z3::expr> WordEncoder::EncodeDecomposition(const std::vector<std::string>& support, const BDD& f)
+{
+    if (support.size() < 2)
+        return std::nullopt;
+
+    BDD nf = !f;
+    for (const auto& name : support)
+    {
+        std::vector<std::string> others;
+        for (const auto& o : support)
+            if (o != name)
+                others.push_back(o);
+        BDD cube_name = VarsCube({name});
+        BDD cube_others = VarsCube(others);
+
+        BDD g = f.ExistAbstract(cube_others);
+        BDD h = f.ExistAbstract(cube_name);
+        if ((g & h) == f)
+            return simplifyAnd(ctx, {Encode(g), Encode(h)});
+
+        BDD ng = nf.ExistAbstract(cube_others);
+        BDD nh = nf.ExistAbstract(cube_name);
+        if ((ng & nh) == nf)
+            return simplifyOr(ctx, {Encode(!ng), Encode(!nh)});
+
+        if (stop)
+            break;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string> WordEncoder::SupportVars(const BDD& f) const
+{
+    std::set<std::string> names;
+    for (auto idx : f.SupportIndices())
+        names.insert(idx_to_var.at(idx).first);
+    return std::vector<std::string>(names.begin(), names.end());
+}
+
+BDD WordEncoder::VarsCube(const std::vector<std::string>& names) const
+{
+    BDD cube = mgr.bddOne();
+    for (const auto& name : names)
+    {
+        auto wv = word_vars.find(name);
+        if (wv == word_vars.end())
+            continue;
+        for (int idx : wv->second.bit_idx)
+            if (idx != -1)
+                cube &= mgr.bddVar(idx);
+    }
+    return cube;
+}
+
+z3::expr WordEncoder::BitTest(int idx) const
+{
+    const auto&[name, bit] = idx_to_var.at(idx);
+    z3::expr var = word_vars.at(name).expr;
+    if (var.is_bool())
+        return var;
+    return var.extract(bit, bit) == ctx.bv_val(1, 1);
+}
+
+bool WordEncoder::CollectIntervals(const WordVar& v, const BDD& f, int bit, uint64_t lo, std::vector<Interval>& out) const
+{
+    if (f.IsZero())
+        return true;
+
+    if (f.IsOne())
+    {
+        uint64_t hi = lo | FullMask(bit + 1);
+        if (!out.empty() && out.back().second + 1 == lo)
+            out.back().second = hi;
+        else if (out.size() >= max_atoms)
+            return false;
+        else
+            out.emplace_back(lo, hi);
+        return true;
+    }
+
+    if (stop)
+        return false;
+
+    assert(bit >= 0);
+    uint64_t upper = lo | (1ULL << bit);
+    int idx = v.bit_idx[bit];
+    if (idx == -1)
+        return CollectIntervals(v, f, bit - 1, lo, out) && CollectIntervals(v, f, bit - 1, upper, out);
+
+    BDD b = mgr.bddVar(idx);
+    return CollectIntervals(v, f.Cofactor(!b), bit - 1, lo, out) && CollectIntervals(v, f.Cofactor(b), bit - 1, upper, out);
+}
+
+bool WordEncoder::CollectCubes(const BDD& f, uint64_t mask, uint64_t val, std::vector<Cube>& out) const
+{
+    if (f.IsZero())
+        return true;
+
+    if (f.IsOne())
+    {
+        if (out.size() >= max_atoms)
+            return false;
+        out.emplace_back(mask, val);
+        return true;
+    }
+
+    if (stop)
+        return false;
+
+    int idx = f.NodeReadIndex();
+    uint64_t m = 1ULL << idx_to_var.at(idx).second;
+    BDD b = mgr.bddVar(idx);
+    return CollectCubes(f.Cofactor(!b), mask | m, val, out) && CollectCubes(f.Cofactor(b), mask | m, val | m, out);
+}
+
+z3::expr WordEncoder::IntervalToFormula(const WordVar& v, const Interval& in) const
+{
+    const auto&[lo, hi] = in;
+    if (lo == hi)
+        return v.expr == ctx.bv_val(lo, v.width);
+    if (lo == 0)
+        return z3::ule(v.expr, ctx.bv_val(hi, v.width));
+    if (hi == FullMask(v.width))
+        return z3::uge(v.expr, ctx.bv_val(lo, v.width));
+    return z3::ule(ctx.bv_val(lo, v.width), v.expr) && z3::ule(v.expr, ctx.bv_val(hi, v.width));
+}
+
+z3::expr WordEncoder::MaskedToFormula(const WordVar& v, uint64_t mask, uint64_t val) const
+{
+    if (mask == FullMask(v.width))
+        return v.expr == ctx.bv_val(val, v.width);
+
+    int lo = __builtin_ctzll(mask);
+    uint64_t run = mask >> lo;
+    if ((run & (run + 1)) == 0)
+    {
+        int len = 64 - __builtin_clzll(run);
+        return v.expr.extract(lo + len - 1, lo) == ctx.bv_val(val >> lo, len);
+    }
+    return (v.expr & ctx.bv_val(mask, v.width)) == ctx.bv_val(val, v.width);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <map>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <optional>
+#include <z3++.h>
+#include "ExprToBDDTransformer.h"
+
+// Converts a BDD to a formula over whole bit-vector variables. Unsigned ranges,
+// fixed bits, equalities between variables and independent conjuncts/disjuncts
+// are recognized on every subfunction; only what remains is emitted as single-bit ite.
+class WordEncoder
+{
+public:
+    WordEncoder(Cudd& manager, z3::context& ctx, const std::map<std::string, z3::expr>& vars, const std::map<int, std::pair<std::string, int>>& idx_to_var, const std::atomic<bool>& stop);
+
+    z3::expr Encode(const BDD& bdd);
+
+private:
+    using Interval = std::pair<uint64_t, uint64_t>;
+    using Cube = std::pair<uint64_t, uint64_t>;
+
+    struct WordVar
+    {
+        z3::expr expr;
+        int width;
+        std::vector<int> bit_idx;
+    };
+
+    Cudd& mgr;
+    z3::context& ctx;
+    const std::map<int, std::pair<std::string, int>>& idx_to_var;
+    const std::atomic<bool>& stop;
+    std::map<std::string, WordVar> word_vars;
+    std::map<DdNode*, std::pair<BDD, z3::expr>> cache;
+
+    // limits on the number of ranges/cubes before a single-variable
+    // function is considered irregular, and on the size of functions
+    // that are analysed for word-level structure at all
+    std::size_t max_atoms = 4;
+    int max_analysed_nodes = 4096;
+
+    z3::expr EncodeNode(const BDD& f);
+    z3::expr EncodeIte(const BDD& f);
+    z3::expr EncodeCube(const BDD& cube);
+    std::optional<z3::expr> EncodeSingle(const WordVar& v, const BDD& f);
+    std::optional<z3::expr> EncodeEquality(const std::vector<std::string>& support, const BDD& f);
+    std::optional<z3::expr> EncodeDecomposition(const std::vector<std::string>& support, const BDD& f);
+
+    std::vector<std::string> SupportVars(const BDD& f) const;
+    BDD VarsCube(const std::vector<std::string>& names) const;
+    z3::expr BitTest(int idx) const;
+
+    bool CollectIntervals(const WordVar& v, const BDD& f, int bit, uint64_t lo, std::vector<Interval>& out) const;
+    bool CollectCubes(const BDD& f, uint64_t mask, uint64_t val, std::vector<Cube>& out) const;
+
+    z3::expr IntervalToFormula(const WordVar& v, const Interval& in) const;
+    z3::expr MaskedToFormula(const WordVar& v, uint64_t mask, uint64_t val) const;
+    uint64_t FullMask(int width) const { return width >= 64 ? ~0ULL : (1ULL << width) - 1; }
+};
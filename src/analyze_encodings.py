@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+
+import sys
+from collections import defaultdict
+from statistics import median
+
+SECONDARY_TOOLS = ['z3', 'cvc5', 'bitw']
+
+def is_solved(result):
+    return result == 'sat' or result == 'unsat'
+
+def load(filename):
+    # benchmark -> encoding -> (size, fbs duration, {tool: (result, duration)})
+    data = defaultdict(dict)
+    with open(filename) as file:
+        lines = file.read().strip().split('\n')
+    for line in lines:
+        benchmark, enc, size, dur, *results = [p.strip() for p in line.split(',')]
+        tools = {t: (r, int(d)) for t, r, d in zip(SECONDARY_TOOLS, results[::2], results[1::2])}
+        data[benchmark][enc] = (int(size), int(dur), tools)
+    return data
+
+def main():
+    filename = sys.argv[1] if len(sys.argv) > 1 else 'encodings.txt'
+    data = load(filename)
+    encodings = sorted({e for d in data.values() for e in d.keys()})
+
+    for enc in encodings:
+        size_ratios = []
+        solved = defaultdict(int)
+        solve_time = defaultdict(int)
+        for benchmark, by_enc in data.items():
+            if enc not in by_enc:
+                continue
+            size, _, tools = by_enc[enc]
+            if 'ite' in by_enc and by_enc['ite'][0] > 0:
+                size_ratios.append(size / by_enc['ite'][0])
+            for t, (r, d) in tools.items():
+                if is_solved(r):
+                    solved[t] += 1
+                    solve_time[t] += d
+
+        print(f'{enc}:')
+        if size_ratios:
+            print(f'    size vs ite: median {median(size_ratios):.3f}, min {min(size_ratios):.3f}, max {max(size_ratios):.3f}')
+        for t in SECONDARY_TOOLS:
+            print(f'    {t}: {solved[t]} solved, {solve_time[t] / 1000:.1f} s total on solved')
+
+if __name__ == "__main__":
+    main()
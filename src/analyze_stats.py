@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+
+import sys
+import json
+from statistics import mean
+
+from analyze import is_solved, SECONDARY_TOOLS
+
+def load_stats(filename):
+    stats = {}
+    with open(filename) as file:
+        for line in file:
+            if line.strip():
+                record = json.loads(line)
+                stats[record['input']] = record
+    return stats
+
+def load_results(filename):
+    with open(filename) as file:
+        header, *lines = file.read().strip().split('\n')
+    tool_names = [t.strip() for t in header.split(',')[1:]]
+    res = {}
+    for line in lines:
+        benchmark, *results = [p.strip() for p in line.split(',')]
+        res[benchmark] = dict(zip(tool_names, results))
+    return res
+
+def effort(record):
+    jobs = record['jobs']
+    return {
+        'jobs': len(jobs),
+        'cpu_seconds': sum(j['cpu_seconds'] for j in jobs),
+        'rounds': sum(j['rounds'] for j in jobs),
+        'peak_live_nodes': max([j['peak_live_nodes'] for j in jobs], default=0),
+        'peak_rss_kb': record['peak_rss_kb'],
+    }
+
+def main():
+    if len(sys.argv) != 4:
+        print(f'Usage: {sys.argv[0]} <stats.jsonl> <results.csv> <myapp tool, e.g. myapp_20+bitw_40>')
+        sys.exit(1)
+
+    stats = load_stats(sys.argv[1])
+    results = load_results(sys.argv[2])
+    tool = sys.argv[3]
+    secondary = tool.split('+')[1].split('_')[0]
+    baseline = [t for t in next(iter(results.values())).keys() if t.startswith(secondary + '_') and '+' not in t]
+
+    groups = {'gained': [], 'lost': [], 'same': []}
+    for benchmark, record in stats.items():
+        if benchmark not in results:
+            continue
+        res = results[benchmark]
+        with_fbs = is_solved(res[tool])
+        without_fbs = any(is_solved(res[b]) for b in baseline)
+        group = 'gained' if with_fbs and not without_fbs else 'lost' if without_fbs and not with_fbs else 'same'
+        groups[group].append(effort(record))
+
+    for group, efforts in groups.items():
+        print(f'{group}: {len(efforts)} benchmarks')
+        if not efforts:
+            continue
+        for key in efforts[0].keys():
+            print(f'    {key}: mean {mean(e[key] for e in efforts):.2f}')
+
+if __name__ == "__main__":
+    main()
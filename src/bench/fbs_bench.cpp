@@ -0,0 +1,404 @@
+// Microbenchmarks of the FBS hot paths. Every case runs on fixed synthetic
+// formulas (fixed seeds) and on recorded SMT-LIB files given by --input, and
+// reports time and C++ heap allocations per operation. Results can be saved
+// and compared against a previous run to catch regressions early.
+
+#include <new>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+
+#include "antlr4-runtime.h"
+#include "SMTLIBv2Lexer.h"
+#include "SMTLIBv2Parser.h"
+
+#include "FBS_SMTVisitor.h"
+#include "FormulaSimplifier.h"
+#include "SimplifierThread.h"
+#include "SimplifierBasic.h"
+
+using namespace antlr4;
+
+// Z3 and CUDD allocate through malloc, so only allocations made by FBS
+// itself (and the standard containers it uses) are counted.
+static std::atomic<std::size_t> allocations{0};
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+struct BenchResult
+{
+    std::string name;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+class Bench
+{
+public:
+    void Run(const std::string& name, const std::function<void()>& op)
+    {
+        using clck = std::chrono::steady_clock;
+
+        op();
+
+        std::size_t iters = 1;
+        while (true)
+        {
+            auto start = clck::now();
+            for (std::size_t i = 0; i < iters; ++i)
+                op();
+            if (clck::now() - start >= std::chrono::milliseconds(50) || iters >= (1u << 20))
+                break;
+            iters *= 2;
+        }
+
+        std::vector<std::pair<double, double>> samples;
+        for (int s = 0; s < n_samples; ++s)
+        {
+            auto allocs_start = allocations.load();
+            auto start = clck::now();
+            for (std::size_t i = 0; i < iters; ++i)
+                op();
+            auto ns = std::chrono::duration<double, std::nano>(clck::now() - start).count();
+            samples.emplace_back(ns / iters, double(allocations.load() - allocs_start) / iters);
+        }
+        std::sort(samples.begin(), samples.end());
+        auto median = samples[samples.size() / 2];
+        results.push_back(BenchResult{name, median.first, median.second});
+        std::cerr << "." << std::flush;
+    }
+
+    const std::vector<BenchResult>& GetResults() const { return results; }
+
+private:
+    int n_samples = 5;
+    std::vector<BenchResult> results;
+};
+
+z3::expr RandomTerm(z3::context& ctx, std::mt19937& rng, const std::vector<z3::expr>& leaves, int depth, unsigned width)
+{
+    if (depth == 0 || rng() % 4 == 0)
+    {
+        if (rng() % 4 == 0)
+            return ctx.bv_val((uint64_t)(rng() % 256), width);
+        return leaves[rng() % leaves.size()];
+    }
+
+    auto a = RandomTerm(ctx, rng, leaves, depth - 1, width);
+    auto b = RandomTerm(ctx, rng, leaves, depth - 1, width);
+    switch (rng() % 6)
+    {
+        case 0: return a + b;
+        case 1: return a * b;
+        case 2: return a & b;
+        case 3: return a | b;
+        case 4: return a ^ b;
+        default: return a - b;
+    }
+}
+
+z3::expr SyntheticFormula(z3::context& ctx, unsigned seed, int n_free, int n_bound, unsigned width, int n_atoms, int depth, bool forall = true)
+{
+    std::mt19937 rng(seed);
+
+    std::vector<z3::expr> leaves;
+    z3::expr_vector bound(ctx);
+    for (int i = 0; i < n_free; ++i)
+        leaves.push_back(ctx.bv_const(("a" + std::to_string(i)).c_str(), width));
+    for (int i = 0; i < n_bound; ++i)
+    {
+        auto x = ctx.bv_const(("x" + std::to_string(i)).c_str(), width);
+        leaves.push_back(x);
+        bound.push_back(x);
+    }
+
+    std::vector<z3::expr> atoms;
+    for (int i = 0; i < n_atoms; ++i)
+    {
+        auto a = RandomTerm(ctx, rng, leaves, depth, width);
+        auto b = RandomTerm(ctx, rng, leaves, depth, width);
+        switch (rng() % 3)
+        {
+            case 0: atoms.push_back(z3::ule(a, b)); break;
+            case 1: atoms.push_back(a == b); break;
+            default: atoms.push_back(!(a < b)); break;
+        }
+    }
+
+    std::vector<z3::expr> clauses;
+    for (std::size_t i = 0; i + 1 < atoms.size(); i += 2)
+        clauses.push_back(atoms[i] || atoms[i + 1]);
+    return forall ? z3::forall(bound, simplifyAnd(ctx, clauses)) : z3::exists(bound, simplifyAnd(ctx, clauses));
+}
+
+// Conjunction of existential formulas over the same free variables, the
+// shape the existential fast path is meant for.
+z3::expr ExistentialFamily(z3::context& ctx, unsigned seed, int n_quants, int n_free, int n_bound, unsigned width, int n_atoms, int depth)
+{
+    std::vector<z3::expr> conj;
+    for (int i = 0; i < n_quants; ++i)
+        conj.push_back(SyntheticFormula(ctx, seed + i, n_free, n_bound, width, n_atoms, depth, false));
+    return simplifyAnd(ctx, conj);
+}
+
+std::string ToScript(const z3::expr& e)
+{
+    Z3_set_ast_print_mode(e.ctx(), Z3_PRINT_SMTLIB2_COMPLIANT);
+    std::string script = Z3_benchmark_to_smtlib_string(e.ctx(), "", "BV", "unknown", "", 0, NULL, e);
+    return script.substr(0, script.find("(check-sat)"));
+}
+
+void Parse(const std::string& script, const std::function<void(FBS_SMTVisitor&)>& use = nullptr)
+{
+    ANTLRInputStream input(script);
+    SMTLIBv2Lexer lexer(&input);
+    CommonTokenStream tokens(&lexer);
+    SMTLIBv2Parser parser(&tokens);
+    SMTLIBv2Parser::StartContext* tree = parser.start();
+
+    FBS_SMTVisitor interpreter;
+    interpreter.SetConfig(Config());
+    interpreter.Run(tree->script());
+    if (use)
+        use(interpreter);
+}
+
+void RunCases(Bench& bench, const std::string& label, const std::string& script, z3::expr e)
+{
+    z3::context other;
+
+    bench.Run(label + "/Parse", [&] { Parse(script); });
+
+    bench.Run(label + "/Translate", [&] { Translate(e, other); });
+
+    FormulaSimplifier fs(e);
+    std::list<SimplifierThread> no_threads;
+    bench.Run(label + "/FormulaSimplifier::Simplify", [&] {
+        auto it = no_threads.begin();
+        fs.Simplify(e, 0, it, true, true, 2);
+    });
+
+    std::vector<z3::expr> atoms;
+    z3::expr body = e.is_quantifier() ? e.body() : e;
+    for (unsigned i = 0; i < body.num_args() && body.is_app(); ++i)
+        atoms.push_back(body.arg(i));
+    if (!atoms.empty())
+    {
+        bench.Run(label + "/simplifyAnd", [&] { simplifyAnd(e.ctx(), atoms); });
+        bench.Run(label + "/simplifyOr", [&] { simplifyOr(e.ctx(), atoms); });
+    }
+
+    Settings settings;
+    FBSLogger logger;
+    std::atomic<bool> stop = false;
+    TimeoutManager budget;
+    SimplifierThread thread(SimplifierEnv{settings, logger, stop, budget, nullptr, e.ctx()}, e, true, {});
+    bench.Run(label + "/CollectVars", [&] { thread.CollectVars(thread.GetExpr(), 0); });
+
+    thread.Prepare();
+    for (int bw : {2, 4, 8})
+    {
+        BDD bdd = thread.Approximate(bw, 1);
+        if (bdd.IsZero() || bdd.IsOne())
+            continue;
+        auto name = label + "/bw" + std::to_string(bw) + "/";
+        bench.Run(name + "BDDToFormula", [&] { thread.BDDToFormula(bdd); });
+        bench.Run(name + "BDDToFormulaWord", [&] { thread.BDDToFormulaWord(bdd); });
+        bench.Run(name + "BDDToFormulaApprox", [&] { thread.BDDToFormulaApprox(bdd, 5); });
+    }
+}
+
+// The whole formula under-approximation job with and without the existential
+// fast path; the BDD sizes are recorded next to the times.
+void RunExistentialCases(Bench& bench, const std::string& label, z3::expr e, std::vector<std::pair<std::string, int>>& nodes)
+{
+    Settings settings;
+    FBSLogger logger;
+    std::atomic<bool> stop = false;
+    TimeoutManager budget;
+    for (bool fast : {false, true})
+    {
+        SimplifierThread thread(SimplifierEnv{settings, logger, stop, budget, nullptr, e.ctx()}, e, false, {});
+        if (fast)
+            thread.EnableExistentialFastPath();
+        thread.Prepare();
+        for (int bw : {2, 4, 8})
+        {
+            auto name = label + "/bw" + std::to_string(bw) + (fast ? "/exists-fast" : "/exists-general") + "/Approximate";
+            BDD bdd;
+            bench.Run(name, [&] { bdd = thread.Approximate(bw, 1); });
+            nodes.emplace_back(name, bdd.nodeCount());
+        }
+    }
+}
+
+// With a single pick, PickResults keeps only the last approximation of a
+// job, so with the minimization it has to be sound and at least as precise
+// as the last one without it on its own.
+bool CheckMinimizedResult(const std::string& label, z3::expr e)
+{
+    FBSLogger logger;
+    std::atomic<bool> stop = false;
+    TimeoutManager budget;
+    std::vector<z3::expr> last;
+    for (bool minimize : {false, true})
+    {
+        Settings settings;
+        settings.minimize = minimize;
+        SimplifierThread thread(SimplifierEnv{settings, logger, stop, budget, nullptr, e.ctx()}, e, true, {});
+        thread.Run(e.ctx());
+        auto res = thread.GetResult(e.ctx());
+        if (res.empty())
+            return true;
+        last.push_back(res.back());
+    }
+
+    z3::solver unsound(e.ctx());
+    unsound.add(e && !last[1]);
+    z3::solver weaker(e.ctx());
+    weaker.add(last[1] && !last[0]);
+    if (unsound.check() == z3::unsat && weaker.check() == z3::unsat)
+        return true;
+    std::cout << "minimized result of " << label << " is unsound or less precise\n";
+    return false;
+}
+
+std::map<std::string, BenchResult> LoadBaseline(const std::string& filename)
+{
+    std::map<std::string, BenchResult> res;
+    std::ifstream in(filename);
+    BenchResult r;
+    while (in >> r.name >> r.ns_per_op >> r.allocs_per_op)
+        res[r.name] = r;
+    return res;
+}
+
+void PrintUsage(const char* argv0)
+{
+    std::cout << "Usage: " << argv0 << " [options]\n";
+    std::cout << "Available options:\n";
+    std::cout << "    --input:file.smt2 also benchmark on a recorded input, can be repeated\n";
+    std::cout << "    --save:file writes the results to file\n";
+    std::cout << "    --baseline:file compares the results with a file written by --save\n";
+    std::cout << "    --threshold:n allowed slowdown against the baseline in percent, default 10\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> inputs;
+    std::string save_file, baseline_file;
+    int threshold = 10;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int x = 0;
+        if (arg.rfind("--input:", 0) == 0)
+            inputs.push_back(arg.substr(8));
+        else if (arg.rfind("--save:", 0) == 0)
+            save_file = arg.substr(7);
+        else if (arg.rfind("--baseline:", 0) == 0)
+            baseline_file = arg.substr(11);
+        else if (sscanf(argv[i], "--threshold:%d", &x) == 1 && x >= 0)
+            threshold = x;
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    Bench bench;
+
+    z3::context ctx;
+    std::vector<std::pair<std::string, z3::expr>> synthetic = {
+        {"synthetic-small", SyntheticFormula(ctx, 1, 2, 1, 8, 8, 2)},
+        {"synthetic-wide", SyntheticFormula(ctx, 2, 3, 2, 32, 12, 2)},
+        {"synthetic-deep", SyntheticFormula(ctx, 3, 2, 2, 16, 6, 4)},
+    };
+    for (const auto&[label, e] : synthetic)
+        RunCases(bench, label, ToScript(e), e);
+
+    // small enough for the jobs to run to the end
+    bool failed = false;
+    for (unsigned seed : {4, 5, 6})
+        failed |= !CheckMinimizedResult("minimize-" + std::to_string(seed), SyntheticFormula(ctx, seed, 2, 1, 8, 8, 2));
+
+    std::vector<std::pair<std::string, int>> nodes;
+    std::vector<std::pair<std::string, z3::expr>> existential = {
+        {"exists-chain", ExistentialFamily(ctx, 10, 4, 2, 2, 8, 6, 2)},
+        {"exists-wide", ExistentialFamily(ctx, 20, 6, 3, 2, 16, 8, 2)},
+    };
+    for (const auto&[label, e] : existential)
+        RunExistentialCases(bench, label, e, nodes);
+
+    for (const auto& filename : inputs)
+    {
+        std::ifstream in(filename);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::string script = ss.str();
+        script = script.substr(0, script.find("(check-sat)"));
+
+        Parse(script, [&](FBS_SMTVisitor& visitor) {
+            auto label = filename.substr(filename.find_last_of('/') + 1);
+            RunCases(bench, label, script, visitor.GetAssertions());
+        });
+    }
+    std::cerr << std::endl;
+
+    auto baseline = baseline_file.empty() ? std::map<std::string, BenchResult>{} : LoadBaseline(baseline_file);
+    bool regression = false;
+
+    std::cout << std::left << std::setw(60) << "benchmark" << std::right << std::setw(14) << "ns/op" << std::setw(12) << "allocs/op" << std::setw(12) << "vs base" << "\n";
+    for (const auto& r : bench.GetResults())
+    {
+        std::cout << std::left << std::setw(60) << r.name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << r.ns_per_op << std::setprecision(1) << std::setw(12) << r.allocs_per_op;
+        auto b = baseline.find(r.name);
+        if (b != baseline.end())
+        {
+            double ratio = r.ns_per_op / b->second.ns_per_op;
+            std::cout << std::setprecision(3) << std::setw(12) << ratio;
+            if (ratio > 1 + threshold / 100.0 || r.allocs_per_op > b->second.allocs_per_op * (1 + threshold / 100.0) + 0.5)
+            {
+                std::cout << "  REGRESSION";
+                regression = true;
+            }
+        }
+        std::cout << "\n";
+    }
+
+    std::cout << "\n" << std::left << std::setw(60) << "BDD nodes" << std::right << std::setw(14) << "nodes" << "\n";
+    for (const auto&[name, count] : nodes)
+        std::cout << std::left << std::setw(60) << name << std::right << std::setw(14) << count << "\n";
+
+    if (!save_file.empty())
+    {
+        std::ofstream out(save_file);
+        for (const auto& r : bench.GetResults())
+            out << r.name << " " << r.ns_per_op << " " << r.allocs_per_op << "\n";
+    }
+
+    return regression || failed ? 1 : 0;
+}
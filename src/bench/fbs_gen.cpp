@@ -0,0 +1,197 @@
+// Generates families of quantified bit-vector formulas with controlled shape
+// for scaling studies of FBS. The output is an SMT-LIB v2 script on stdout.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <algorithm>
+
+struct GenParams
+{
+    int quants = 4;
+    int depth = 2;
+    std::string quantifier = "alt";
+    int width = 16;
+    int free_vars = 2;
+    int atoms = 4;
+    int term_depth = 2;
+    int sharing = 50;
+    int arith = 50;
+    unsigned seed = 1;
+};
+
+class FormulaGenerator
+{
+public:
+    FormulaGenerator(const GenParams& p) : params(p), rng(p.seed) {}
+
+    std::string Generate()
+    {
+        std::ostringstream out;
+        out << "(set-logic BV)\n";
+        for (int i = 0; i < params.free_vars; ++i)
+            out << "(declare-fun a" << i << " () " << Sort() << ")\n";
+
+        for (int q = 0; q < params.quants; ++q)
+        {
+            std::vector<std::string> scope;
+            for (int i = 0; i < params.free_vars; ++i)
+                scope.push_back("a" + std::to_string(i));
+            out << "(assert " << Quantified(scope, 0) << ")\n";
+        }
+        out << "(check-sat)\n(exit)\n";
+        return out.str();
+    }
+
+private:
+    GenParams params;
+    std::mt19937 rng;
+    int next_var = 0;
+    int next_let = 0;
+
+    int Rand(int n) { return (int)(rng() % (unsigned)n); }
+
+    std::string Sort() const { return "(_ BitVec " + std::to_string(params.width) + ")"; }
+
+    std::string Constant()
+    {
+        return "(_ bv" + std::to_string(rng() % (1u << std::min(params.width, 16))) + " " + std::to_string(params.width) + ")";
+    }
+
+    bool IsForall(int level) const
+    {
+        if (params.quantifier == "forall")
+            return true;
+        if (params.quantifier == "exists")
+            return false;
+        return level % 2 == 0;
+    }
+
+    std::string Quantified(std::vector<std::string>& scope, int level)
+    {
+        std::string var = "x" + std::to_string(next_var++);
+        scope.push_back(var);
+        std::size_t shared_start = shared_terms.size();
+
+        std::vector<std::string> lits;
+        for (int i = 0; i < params.atoms; ++i)
+            lits.push_back(Atom(scope));
+        if (level + 1 < params.depth)
+            lits.push_back(Quantified(scope, level + 1));
+
+        scope.pop_back();
+
+        std::string body = Shared(lits, shared_start);
+        return std::string("(") + (IsForall(level) ? "forall" : "exists") + " ((" + var + " " + Sort() + ")) " + body + ")";
+    }
+
+    // Builds the body of a quantifier and binds the terms shared at this
+    // level with let. Each binding gets its own let, because a shared term
+    // may use the previous ones.
+    std::string Shared(const std::vector<std::string>& lits, std::size_t start)
+    {
+        std::string res = std::string("(") + (Rand(2) ? "and" : "or");
+        for (const auto& l : lits)
+            res += " " + l;
+        res += ")";
+
+        for (std::size_t i = shared_terms.size(); i > start; --i)
+            res = "(let ((" + shared_terms[i - 1].first + " " + shared_terms[i - 1].second + ")) " + res + ")";
+        shared_terms.resize(start);
+        return res;
+    }
+
+    // terms bound by let in the enclosing quantifier bodies, usable by
+    // any term generated inside them
+    std::vector<std::pair<std::string, std::string>> shared_terms;
+
+    std::string Term(const std::vector<std::string>& scope, int depth)
+    {
+        if (depth == 0 || Rand(4) == 0)
+        {
+            if (Rand(5) == 0)
+                return Constant();
+            return scope[Rand((int)scope.size())];
+        }
+
+        if (!shared_terms.empty() && Rand(100) < params.sharing)
+            return shared_terms[Rand((int)shared_terms.size())].first;
+
+        static const char* arith_ops[] = {"bvadd", "bvmul", "bvsub", "bvudiv", "bvurem"};
+        static const char* bitwise_ops[] = {"bvand", "bvor", "bvxor", "bvshl", "bvlshr"};
+        const char* op = Rand(100) < params.arith ? arith_ops[Rand(5)] : bitwise_ops[Rand(5)];
+        std::string term = std::string("(") + op + " " + Term(scope, depth - 1) + " " + Term(scope, depth - 1) + ")";
+
+        if (Rand(100) < params.sharing)
+        {
+            std::string name = "t" + std::to_string(next_let++);
+            shared_terms.emplace_back(name, term);
+            return name;
+        }
+        return term;
+    }
+
+    std::string Atom(const std::vector<std::string>& scope)
+    {
+        static const char* preds[] = {"bvule", "bvult", "bvsle", "="};
+        std::string atom = std::string("(") + preds[Rand(4)] + " " + Term(scope, params.term_depth) + " " + Term(scope, params.term_depth) + ")";
+        return Rand(4) == 0 ? "(not " + atom + ")" : atom;
+    }
+};
+
+void PrintUsage(const char* argv0)
+{
+    std::cout << "Usage: " << argv0 << " [options]\n";
+    std::cout << "Available options:\n";
+    std::cout << "    --quants:n number of top-level quantifier chains, default 4\n";
+    std::cout << "    --depth:n nesting depth of each chain, default 2\n";
+    std::cout << "    --quantifier:[forall/exists/alt] kind of the quantifiers, alt alternates starting with forall, default alt\n";
+    std::cout << "    --width:n bit-width of all variables, default 16\n";
+    std::cout << "    --free-vars:n number of free variables, default 2\n";
+    std::cout << "    --atoms:n atoms in each quantifier body, default 4\n";
+    std::cout << "    --term-depth:n maximum depth of terms in atoms, default 2\n";
+    std::cout << "    --sharing:n percentage of terms shared through let, default 50\n";
+    std::cout << "    --arith:n percentage of arithmetic (vs. bitwise) operators, default 50\n";
+    std::cout << "    --seed:n random seed, default 1\n";
+}
+
+int main(int argc, char** argv)
+{
+    GenParams params;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        int x = 0;
+        if (sscanf(argv[i], "--quants:%d", &x) == 1 && x >= 0)
+            params.quants = x;
+        else if (sscanf(argv[i], "--depth:%d", &x) == 1 && x >= 1)
+            params.depth = x;
+        else if (arg == "--quantifier:forall" || arg == "--quantifier:exists" || arg == "--quantifier:alt")
+            params.quantifier = arg.substr(13);
+        else if (sscanf(argv[i], "--width:%d", &x) == 1 && x >= 1)
+            params.width = x;
+        else if (sscanf(argv[i], "--free-vars:%d", &x) == 1 && x >= 1)
+            params.free_vars = x;
+        else if (sscanf(argv[i], "--atoms:%d", &x) == 1 && x >= 1)
+            params.atoms = x;
+        else if (sscanf(argv[i], "--term-depth:%d", &x) == 1 && x >= 0)
+            params.term_depth = x;
+        else if (sscanf(argv[i], "--sharing:%d", &x) == 1 && x >= 0 && x <= 100)
+            params.sharing = x;
+        else if (sscanf(argv[i], "--arith:%d", &x) == 1 && x >= 0 && x <= 100)
+            params.arith = x;
+        else if (sscanf(argv[i], "--seed:%d", &x) == 1)
+            params.seed = (unsigned)x;
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    FormulaGenerator gen(params);
+    std::cout << gen.Generate();
+}
@@ -0,0 +1,466 @@
+// Runs the benchmark evaluation of FBS: every benchmark is solved by the
+// baseline solvers and by FBS followed by each secondary solver on its
+// output, for every requested split of the time limit. Up to --jobs:n
+// processes run concurrently, each in a private temporary directory and
+// under CPU time and memory limits. The results are written in the format
+// of results_60s_complete.csv.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+namespace fs = std::filesystem;
+
+struct RunResult
+{
+    std::string result;
+    long long duration_ms;
+};
+
+struct RunnerOptions
+{
+    int jobs = 1;
+    int timeout = 60;
+    std::vector<int> splits;
+    long long memory_mb = 8192;
+    bool pin = false;
+    bool baseline = true;
+    std::string fbs_cmd = "../build/fbs";
+    std::vector<std::pair<std::string, std::string>> tools = {
+        {"z3", "z3"},
+        {"q3b", "../build/external/q3b/q3b"},
+        {"cvc5", "cvc5"},
+        {"bitw", "bitwuzla"},
+    };
+    std::vector<std::string> secondary = {"z3", "cvc5", "bitw"};
+    std::string output = "results.csv";
+    std::string durations;
+    std::vector<std::string> fbs_args;
+};
+
+// Runs `cmd` through the shell in `dir` with stdout redirected to `out_file`.
+// The process gets its own process group, so that the whole group can be
+// killed on timeout, and is optionally pinned to `cpu`. With `cpu_limit`,
+// its CPU time is limited to the timeout as well, which only fits
+// single-threaded tools.
+RunResult RunProcess(const std::string& cmd, const fs::path& dir, const fs::path& out_file, int timeout, long long memory_mb, int cpu, bool cpu_limit = true)
+{
+    using clck = std::chrono::steady_clock;
+
+    // everything the child needs is prepared before fork, as only
+    // async-signal-safe calls are allowed after it
+    std::string shell_cmd = "exec " + cmd;
+    std::string dir_str = dir.string();
+    std::string out_str = out_file.string();
+    const char* argv[] = {"/bin/sh", "-c", shell_cmd.c_str(), nullptr};
+    rlimit cpu_rlimit{(rlim_t)timeout + 1, (rlim_t)timeout + 2};
+    rlimit mem_limit{(rlim_t)memory_mb << 20, (rlim_t)memory_mb << 20};
+
+    auto start = clck::now();
+    pid_t pid = fork();
+    if (pid < 0)
+        return RunResult{"crash", 0};
+
+    if (pid == 0)
+    {
+        setpgid(0, 0);
+        if (cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        if (cpu_limit)
+            setrlimit(RLIMIT_CPU, &cpu_rlimit);
+        if (memory_mb > 0)
+            setrlimit(RLIMIT_AS, &mem_limit);
+        if (chdir(dir_str.c_str()) != 0)
+            _exit(127);
+        int out = open(out_str.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(out, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], (char* const*)argv);
+        _exit(127);
+    }
+
+    int status = 0;
+    bool timed_out = false;
+    while (waitpid(pid, &status, WNOHANG) == 0)
+    {
+        if (clck::now() - start > std::chrono::seconds(timeout))
+        {
+            timed_out = true;
+            kill(-pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    long long duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(clck::now() - start).count();
+
+    // kill whatever the tool left running in its group
+    kill(-pid, SIGKILL);
+
+    if (timed_out || (WIFSIGNALED(status) && (WTERMSIG(status) == SIGXCPU || WTERMSIG(status) == SIGKILL)))
+        return RunResult{"timeout", duration_ms};
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return RunResult{"crash", duration_ms};
+
+    std::ifstream in(out_file);
+    std::string line, last;
+    while (std::getline(in, line))
+        if (!line.empty())
+            last = line;
+    return RunResult{last.empty() ? "crash" : last, duration_ms};
+}
+
+class Runner
+{
+public:
+    Runner(const RunnerOptions& o, const std::vector<std::string>& b) : opts(o), benchmarks(b)
+    {
+        // processes run in their own directories, so relative paths are
+        // resolved against the current one
+        opts.fbs_cmd = ResolveCommand(opts.fbs_cmd);
+        for (auto&[name, cmd] : opts.tools)
+        {
+            cmd = ResolveCommand(cmd);
+            columns.push_back(name + "_" + std::to_string(opts.timeout));
+            tool_cmds[name] = cmd;
+        }
+        for (int split : opts.splits)
+            for (const auto& t : opts.secondary)
+                columns.push_back("myapp_" + std::to_string(split) + "+" + t + "_" + std::to_string(opts.timeout - split));
+
+        rows.assign(benchmarks.size(), std::vector<RunResult>(columns.size()));
+        remaining.assign(benchmarks.size(), columns.size());
+    }
+
+    void Run()
+    {
+        out.open(opts.output, std::ios::app);
+        if (!opts.durations.empty())
+            durations_out.open(opts.durations, std::ios::app);
+        WriteHeader(out);
+        if (durations_out.is_open())
+            WriteHeader(durations_out);
+
+        for (std::size_t b = 0; b < benchmarks.size(); ++b)
+        {
+            for (std::size_t t = 0; t < opts.tools.size(); ++t)
+            {
+                if (opts.baseline)
+                    Push([this, b, t](int cpu) { RunBaseline(b, t, cpu); });
+                else
+                    Finish(b, t, RunResult{"skipped", 0});
+            }
+            for (std::size_t s = 0; s < opts.splits.size(); ++s)
+                Push([this, b, s](int cpu) { RunSplit(b, s, cpu); });
+        }
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < opts.jobs; ++i)
+            workers.emplace_back([this, i] { Work(opts.pin ? i : -1); });
+        for (auto& w : workers)
+            w.join();
+    }
+
+private:
+    using Task = std::function<void(int)>;
+
+    RunnerOptions opts;
+    std::vector<std::string> benchmarks;
+    std::vector<std::string> columns;
+    std::map<std::string, std::string> tool_cmds;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Task> tasks;
+    int running = 0;
+
+    std::vector<std::vector<RunResult>> rows;
+    std::vector<std::size_t> remaining;
+    std::size_t next_row = 0;
+    std::ofstream out, durations_out;
+
+    void Push(Task task, bool front = false)
+    {
+        std::scoped_lock lock(mutex);
+        if (front)
+            tasks.push_front(std::move(task));
+        else
+            tasks.push_back(std::move(task));
+        cv.notify_one();
+    }
+
+    void Work(int cpu)
+    {
+        while (true)
+        {
+            Task task;
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [this] { return !tasks.empty() || running == 0; });
+                if (tasks.empty())
+                {
+                    cv.notify_all();
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                ++running;
+            }
+            task(cpu);
+            {
+                std::scoped_lock lock(mutex);
+                --running;
+            }
+            cv.notify_all();
+        }
+    }
+
+    std::shared_ptr<fs::path> MakeWorkDir()
+    {
+        std::string tmpl = (fs::temp_directory_path() / "fbs_runner.XXXXXX").string();
+        if (!mkdtemp(tmpl.data()))
+            throw std::runtime_error("cannot create a temporary directory");
+        return std::shared_ptr<fs::path>(new fs::path(tmpl), [](fs::path* p) {
+            std::error_code ec;
+            fs::remove_all(*p, ec);
+            delete p;
+        });
+    }
+
+    void RunBaseline(std::size_t b, std::size_t t, int cpu)
+    {
+        auto dir = MakeWorkDir();
+        const auto&[name, cmd] = opts.tools[t];
+        auto res = RunProcess(cmd + " " + Quote(fs::absolute(benchmarks[b]).string()), *dir, *dir / (name + ".out"), opts.timeout, opts.memory_mb, cpu);
+        Finish(b, t, res);
+    }
+
+    // FBS gets `split` seconds, the secondary solvers get the rest of the
+    // time limit that FBS did not use. out.smt2 starts as a copy of the
+    // input, so the solvers get the original formula if FBS fails.
+    void RunSplit(std::size_t b, std::size_t s, int cpu)
+    {
+        int split = opts.splits[s];
+        auto dir = MakeWorkDir();
+        fs::copy_file(benchmarks[b], *dir / "out.smt2");
+
+        std::string cmd = opts.fbs_cmd + " --timeout:" + std::to_string(split - 1);
+        for (const auto& arg : opts.fbs_args)
+            cmd += " " + arg;
+        cmd += " " + Quote(fs::absolute(benchmarks[b]).string());
+        // FBS runs its jobs on all the cores it may use, so a CPU limit of
+        // the split would stop it early; only the wall-clock limit applies
+        auto fbs_res = RunProcess(cmd, *dir, *dir / "fbs.out", split + 2, opts.memory_mb, cpu, false);
+
+        long long fbs_ms = std::min<long long>(fbs_res.duration_ms, split * 1000LL);
+        if (fbs_res.result == "sat" || fbs_res.result == "unsat")
+        {
+            // decided by FBS itself, the secondary solvers are not needed
+            for (std::size_t i = 0; i < opts.secondary.size(); ++i)
+                Finish(b, opts.tools.size() + s * opts.secondary.size() + i, RunResult{fbs_res.result, fbs_ms});
+            return;
+        }
+        int rest = opts.timeout - (int)((fbs_ms + 500) / 1000);
+
+        for (std::size_t i = 0; i < opts.secondary.size(); ++i)
+        {
+            std::size_t column = opts.tools.size() + s * opts.secondary.size() + i;
+            const auto& tool = opts.secondary[i];
+            Push([this, b, column, tool, dir, rest, fbs_ms](int cpu) {
+                auto res = RunProcess(tool_cmds[tool] + " out.smt2", *dir, *dir / (tool + ".out"), rest, opts.memory_mb, cpu);
+                res.duration_ms += fbs_ms;
+                Finish(b, column, res);
+            }, true);
+        }
+    }
+
+    void Finish(std::size_t b, std::size_t column, const RunResult& res)
+    {
+        std::scoped_lock lock(mutex);
+        rows[b][column] = res;
+        --remaining[b];
+
+        // rows are written in the order of the benchmark list
+        while (next_row < benchmarks.size() && remaining[next_row] == 0)
+        {
+            WriteRow(next_row);
+            rows[next_row].clear();
+            ++next_row;
+        }
+    }
+
+    void WriteHeader(std::ofstream& file)
+    {
+        if (file.tellp() != 0)
+            return;
+        file << "benchmark";
+        for (const auto& c : columns)
+            file << "," << c;
+        file << "\n";
+    }
+
+    void WriteRow(std::size_t b)
+    {
+        out << benchmarks[b];
+        for (const auto& r : rows[b])
+            out << "," << r.result;
+        out << "\n" << std::flush;
+
+        if (durations_out.is_open())
+        {
+            durations_out << benchmarks[b];
+            for (const auto& r : rows[b])
+                durations_out << "," << r.duration_ms;
+            durations_out << "\n" << std::flush;
+        }
+        std::cerr << "Finished benchmark " << b + 1 << "/" << benchmarks.size() << ": " << benchmarks[b] << std::endl;
+    }
+
+    static std::string ResolveCommand(const std::string& cmd)
+    {
+        auto end = cmd.find(' ');
+        auto program = cmd.substr(0, end);
+        if (program.find('/') == std::string::npos)
+            return cmd;
+        return fs::absolute(program).string() + (end == std::string::npos ? "" : cmd.substr(end));
+    }
+
+    static std::string Quote(const std::string& s)
+    {
+        std::string res = "'";
+        for (char c : s)
+            res += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        return res + "'";
+    }
+};
+
+void PrintUsage(const char* argv0)
+{
+    std::cout << "Usage: " << argv0 << " [options] benchmark_list\n";
+    std::cout << "Available options:\n";
+    std::cout << "    --jobs:n number of processes run concurrently, default 1\n";
+    std::cout << "    --timeout:n time limit in seconds for each configuration, default 60\n";
+    std::cout << "    --split:n runs FBS for n seconds and the secondary solvers for the rest, can be repeated; FBS is multi-threaded, so it only gets the wall-clock limit, the solvers also get a CPU time limit\n";
+    std::cout << "    --memory:n memory limit of each process in MB, 0 for no limit, default 8192\n";
+    std::cout << "    --pin:[1/0] pins the i-th job to the i-th CPU if 1, default 0\n";
+    std::cout << "    --baseline:[1/0] whether to run the baseline solvers alone, their results are \"skipped\" if 0, default 1\n";
+    std::cout << "    --fbs:cmd command running FBS, default ../build/fbs\n";
+    std::cout << "    --fbs-arg:arg additional argument for FBS, can be repeated\n";
+    std::cout << "    --tool:name=cmd adds a baseline solver, replaces the default z3, q3b, cvc5 and bitw if used\n";
+    std::cout << "    --secondary:name solver run on the output of FBS, can be repeated, default z3, cvc5 and bitw\n";
+    std::cout << "    --output:file.csv appends the results to file.csv, default results.csv\n";
+    std::cout << "    --durations:file.csv appends the durations in ms in the same format to file.csv\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    RunnerOptions opts;
+    bool custom_tools = false, custom_secondary = false;
+    for (int i = 1; i < argc - 1; ++i)
+    {
+        std::string arg = argv[i];
+        int x = 0;
+        if (sscanf(argv[i], "--jobs:%d", &x) == 1 && x > 0)
+            opts.jobs = x;
+        else if (sscanf(argv[i], "--timeout:%d", &x) == 1 && x > 0)
+            opts.timeout = x;
+        else if (sscanf(argv[i], "--split:%d", &x) == 1 && x > 1)
+            opts.splits.push_back(x);
+        else if (sscanf(argv[i], "--memory:%d", &x) == 1 && x >= 0)
+            opts.memory_mb = x;
+        else if (sscanf(argv[i], "--pin:%d", &x) == 1 && x >= 0 && x <= 1)
+            opts.pin = (bool)x;
+        else if (sscanf(argv[i], "--baseline:%d", &x) == 1 && x >= 0 && x <= 1)
+            opts.baseline = (bool)x;
+        else if (arg.rfind("--fbs:", 0) == 0)
+            opts.fbs_cmd = arg.substr(6);
+        else if (arg.rfind("--fbs-arg:", 0) == 0)
+            opts.fbs_args.push_back(arg.substr(10));
+        else if (arg.rfind("--tool:", 0) == 0 && arg.find('=') != std::string::npos)
+        {
+            if (!custom_tools)
+                opts.tools.clear();
+            custom_tools = true;
+            auto eq = arg.find('=');
+            opts.tools.emplace_back(arg.substr(7, eq - 7), arg.substr(eq + 1));
+        }
+        else if (arg.rfind("--secondary:", 0) == 0)
+        {
+            if (!custom_secondary)
+                opts.secondary.clear();
+            custom_secondary = true;
+            opts.secondary.push_back(arg.substr(12));
+        }
+        else if (arg.rfind("--output:", 0) == 0)
+            opts.output = arg.substr(9);
+        else if (arg.rfind("--durations:", 0) == 0)
+            opts.durations = arg.substr(12);
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    for (int split : opts.splits)
+    {
+        if (split >= opts.timeout)
+        {
+            std::cerr << "Split " << split << " is not smaller than the timeout\n";
+            return 1;
+        }
+    }
+    for (const auto& t : opts.secondary)
+    {
+        bool known = false;
+        for (const auto& tool : opts.tools)
+            known |= tool.first == t;
+        if (!known)
+        {
+            std::cerr << "Unknown secondary solver " << t << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<std::string> benchmarks;
+    std::ifstream list(argv[argc - 1]);
+    std::string line;
+    while (std::getline(list, line))
+        if (!line.empty())
+            benchmarks.push_back(line);
+
+    Runner runner(opts, benchmarks);
+    runner.Run();
+}
@@ -0,0 +1,66 @@
+
+if [ "$#" -ne 3 ]; then
+    echo "Usage: $0 <benchmark_list> <tmo for fbs> <tmo for solver>"
+    exit 1
+fi
+
+BENCHMARK_FOLDER="$1"
+MYAPP_TIMEOUT="$2"
+SOLVER_TIMEOUT="$3"
+RESULTS_FILE="encodings.txt"
+
+MYAPP_CMD="$(realpath ../build/fbs)"
+Z3_CMD="z3"
+CVC5_CMD="/home/kouba/cvc5/cvc5/build/bin/cvc5"
+BITW_CMD="bitwuzla"
+
+ENCODINGS=("ite" "word" "dnf:1" "dnf:5" "dnf:20")
+
+declare -A COMMANDS
+COMMANDS["z3"]="$Z3_CMD"
+COMMANDS["cvc5"]="$CVC5_CMD"
+COMMANDS["bitw"]="$BITW_CMD"
+
+SECONDARY_TOOLS=("z3" "cvc5" "bitw")
+
+run_tool() {
+    local timeout_val="$1"
+    shift
+    local start_time_ms=$(date +%s%3N)
+    local output
+    output=$(timeout "$timeout_val" $@ 2>&1)
+    local exit_code=$?
+    local end_time_ms=$(date +%s%3N)
+    local duration_ms=$(( end_time_ms - start_time_ms ))
+    if [ $exit_code -eq 124 ]; then
+        echo "timeout $duration_ms"
+    elif [ $exit_code -gt 0 ]; then
+        echo "crash $duration_ms"
+    else
+        local res
+        res=$(echo "$output" | tail -n 1)
+        echo "$res $duration_ms"
+    fi
+}
+
+cat "$BENCHMARK_FOLDER" | while read -r FILE; do
+    echo "Processing benchmark: $FILE"
+    ABS_FILE=$(realpath "$FILE")
+
+    for enc in "${ENCODINGS[@]}"; do
+        WORK_DIR=$(mktemp -d)
+        cp "$ABS_FILE" "$WORK_DIR/out.smt2"
+
+        read MY_TOOL_RESULT MY_TOOL_DURATION < <(cd "$WORK_DIR" && run_tool "$((MYAPP_TIMEOUT + 2))" "$MYAPP_CMD" --timeout:$((MYAPP_TIMEOUT - 1)) --encoding:$enc "$ABS_FILE")
+        OUT_SIZE=$(wc -c < "$WORK_DIR/out.smt2")
+
+        RES_LINE="$FILE, $enc, $OUT_SIZE, $MY_TOOL_DURATION"
+        for tool in "${SECONDARY_TOOLS[@]}"; do
+            read RESULT DUR < <(run_tool "$SOLVER_TIMEOUT" "${COMMANDS[$tool]}" "$WORK_DIR/out.smt2")
+            RES_LINE+=", $RESULT, $DUR"
+        done
+
+        echo "$RES_LINE" >> "$RESULTS_FILE"
+        rm -r "$WORK_DIR"
+    done
+done
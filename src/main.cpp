@@ -4,6 +4,8 @@
 #include "FBS_SMTVisitor.h"
 #include "TimeoutManager.h"
 #include "FBSLogger.h"
+#include "FBSTracer.h"
+#include "FBSStats.h"
 #include "Settings.h"
 
 #include "antlr4-runtime.h"
@@ -25,9 +27,26 @@ void PrintUsage(const char* argv0)
     std::cout << "Available options:\n";
     std::cout << "    --verbose:[1/0] prints debug output if 1, default 0\n";
     std::cout << "    --timeout:n timeout in seconds, 0 for no timeout, default 0\n";
+    std::cout << "    --reserve:n milliseconds at the end of the timeout kept for assembling and writing the result, default a tenth of the timeout up to 2000\n";
+    std::cout << "    --handoff:r stop once the approximations stopped changing for r times as long as they took so far, 0 to use the whole time, default 0\n";
+    std::cout << "    --triage:[1/0] leaves the input unchanged if cheap features and short probes predict no gain, default 0\n";
+    std::cout << "    --components:[1/0] simplifies the parts of the assertions without common constants separately, default 1\n";
+    std::cout << "    --exists-fast:[1/0] lets Q3B treat the outer existential variables like free ones when deciding the whole formula, default 1\n";
+    std::cout << "    --summaries:[1/0] replaces inner quantifiers by the approximations of their finished jobs when building the outer ones, default 1\n";
     std::cout << "    --use-over:[1/0] whether to use overapproximations, default 1\n";
     std::cout << "    --use-under:[1/0] whether to use underapproximations, default 0\n";
+    std::cout << "    --trace:file.json writes a trace-event profile of the run to file.json\n";
+    std::cout << "    --stats:file.jsonl appends one JSON record with run and per-job statistics to file.jsonl\n";
+    std::cout << "    --miniscope:[1/0] moves quantifiers inwards over and/or and drops unused bound variables before simplifying, default 1\n";
     std::cout << "    --max-quants:n maximum number of quantifiers, 0 for no limit, default 0\n";
+    std::cout << "    --select:[depth/cost] approximate all quantifiers up to a depth, or the ones the cost model predicts to fit the cores and the timeout, default depth\n";
+    std::cout << "    --max-depth:n maximum nesting depth of simplified quantifiers, 0 for no limit, default 0\n";
+    std::cout << "    --threads:n maximum number of simplifier jobs running at once, 0 for no limit, default 0\n";
+    std::cout << "    --speculate:n speculative runs of a job at higher bit-widths on idle cores, 0 to disable, default 2\n";
+    std::cout << "    --schedule:[jobs/rounds] run whole jobs, or single refinement rounds of all jobs with the cheap ones first, default jobs\n";
+    std::cout << "    --encoding:[ite/word/dnf:k] how approximation BDDs are converted to formulas, dnf:k keeps the k shortest paths, default ite\n";
+    std::cout << "    --minimize:[1/0] whether to minimize approximations against the previous one, and to skip or finish on the ones that add nothing to it or decide the quantifier with it, default 1\n";
+    std::cout << "    --max-approx-nodes:n drop approximations with more BDD nodes, 0 for no limit, default 0\n";
 }
 
 int main(int argc, char** argv) 
@@ -38,17 +57,49 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    TimeoutManager time_manager;
+    FBSTracer tracer;
+    FBSStats stats;
+    Settings settings;
+    settings.dump_files = true;
+    FBSTracer::SetCurrent(&tracer);
+
     for (int i = 1; i < argc - 1; ++i)
     {
         int x = 0;
+        double r = 0;
         if (sscanf(argv[i], "--verbose:%d", &x) == 1 && x >= 0 && x <= 1)
         {
-            logger.SetEnabled(x);
+            settings.verbose = (bool)x;
         }
         else if (sscanf(argv[i], "--timeout:%d", &x) == 1 && x >= 0)
         {
             time_manager.SetTimeout(x);
         }
+        else if (sscanf(argv[i], "--reserve:%d", &x) == 1 && x >= 0)
+        {
+            settings.reserve_ms = x;
+        }
+        else if (sscanf(argv[i], "--handoff:%lf", &r) == 1 && r >= 0)
+        {
+            settings.handoff_ratio = r;
+        }
+        else if (sscanf(argv[i], "--triage:%d", &x) == 1 && x >= 0 && x <= 1)
+        {
+            settings.triage = (bool)x;
+        }
+        else if (sscanf(argv[i], "--components:%d", &x) == 1 && x >= 0 && x <= 1)
+        {
+            settings.split_components = (bool)x;
+        }
+        else if (sscanf(argv[i], "--exists-fast:%d", &x) == 1 && x >= 0 && x <= 1)
+        {
+            settings.existential_fast_path = (bool)x;
+        }
+        else if (sscanf(argv[i], "--summaries:%d", &x) == 1 && x >= 0 && x <= 1)
+        {
+            settings.summaries = (bool)x;
+        }
         else if (sscanf(argv[i], "--use-over:%d", &x) == 1 && x >= 0 && x <= 1)
         {
             settings.use_over = (bool)x;
@@ -57,10 +108,71 @@ int main(int argc, char** argv)
         {
             settings.use_under = (bool)x;
         }
+        else if (sscanf(argv[i], "--miniscope:%d", &x) == 1 && x >= 0 && x <= 1)
+        {
+            settings.miniscope = (bool)x;
+        }
         else if (sscanf(argv[i], "--max-quants:%d", &x) == 1)
         {
             settings.max_quants = x;
         }
+        else if (sscanf(argv[i], "--max-depth:%d", &x) == 1 && x >= 0)
+        {
+            settings.max_depth = x;
+        }
+        else if (sscanf(argv[i], "--threads:%d", &x) == 1 && x >= 0)
+        {
+            settings.max_threads = x;
+        }
+        else if (sscanf(argv[i], "--speculate:%d", &x) == 1 && x >= 0)
+        {
+            settings.speculative_runs = x;
+        }
+        else if (sscanf(argv[i], "--minimize:%d", &x) == 1 && x >= 0 && x <= 1)
+        {
+            settings.minimize = (bool)x;
+        }
+        else if (sscanf(argv[i], "--max-approx-nodes:%d", &x) == 1 && x >= 0)
+        {
+            settings.max_approx_nodes = x;
+        }
+        else if (sscanf(argv[i], "--encoding:dnf:%d", &x) == 1 && x > 0)
+        {
+            settings.encoding = Encoding::DNF;
+            settings.dnf_k = x;
+        }
+        else if (std::string(argv[i]).rfind("--trace:", 0) == 0)
+        {
+            tracer.SetOutput(std::string(argv[i]).substr(8));
+        }
+        else if (std::string(argv[i]).rfind("--stats:", 0) == 0)
+        {
+            stats.SetOutput(std::string(argv[i]).substr(8));
+        }
+        else if (std::string(argv[i]) == "--select:depth")
+        {
+            settings.selection = Selection::DEPTH;
+        }
+        else if (std::string(argv[i]) == "--select:cost")
+        {
+            settings.selection = Selection::COST;
+        }
+        else if (std::string(argv[i]) == "--schedule:jobs")
+        {
+            settings.schedule = Schedule::JOBS;
+        }
+        else if (std::string(argv[i]) == "--schedule:rounds")
+        {
+            settings.schedule = Schedule::ROUNDS;
+        }
+        else if (std::string(argv[i]) == "--encoding:ite")
+        {
+            settings.encoding = Encoding::ITE;
+        }
+        else if (std::string(argv[i]) == "--encoding:word")
+        {
+            settings.encoding = Encoding::WORD;
+        }
         else
         {
             PrintUsage(argv[0]);
@@ -69,6 +181,7 @@ int main(int argc, char** argv)
     }
 
     std::string filename = std::string(argv[argc - 1]);
+    stats.SetInput(filename);
 
     std::ifstream stream;
     stream.open(filename);
@@ -83,11 +196,18 @@ int main(int argc, char** argv)
     CommonTokenStream tokens(&lexer);
     SMTLIBv2Parser parser(&tokens);
 
+    TraceScope parse_trace("Parse");
     SMTLIBv2Parser::StartContext* tree = parser.start();
+    parse_trace.End();
+    stats.MarkPhase("Parse");
 
     Config config;
     FBS_SMTVisitor interpreter;
     interpreter.SetConfig(config);
+    interpreter.SetSettings(settings, time_manager, &stats);
     interpreter.Run(tree->script());
+
+    tracer.Write();
+    stats.Write();
 }
 
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+
+# Replays a fixed stratified sample of the benchmarks from a stored results
+# CSV with the current build and fails if the solve rate or the speed of the
+# myapp_X+tool_Y configurations regressed.
+
+import os
+import sys
+import math
+import hashlib
+import argparse
+import subprocess
+from collections import defaultdict
+from statistics import median
+
+from analyze import is_solved
+
+RUNNER_CMD = '../build/fbs_runner'
+TOOL_COMMANDS = {'z3': 'z3', 'cvc5': 'cvc5', 'bitw': 'bitwuzla'}
+
+def load_csv(filename):
+    with open(filename) as file:
+        header, *lines = file.read().strip().split('\n')
+    columns = [c.strip() for c in header.split(',')[1:]]
+    res = {}
+    for line in lines:
+        benchmark, *values = [p.strip() for p in line.split(',')]
+        res[benchmark] = dict(zip(columns, values))
+    return columns, res
+
+def parse_config(column):
+    # myapp_20+bitw_40 -> (20, 'bitw', 40)
+    if not column.startswith('myapp_') or '+' not in column:
+        return None
+    fbs, tool = column.split('+')
+    name, rest = tool.rsplit('_', 1)
+    return int(fbs.split('_')[1]), name, int(rest)
+
+def family(benchmark):
+    parts = benchmark.split('/')
+    return parts[parts.index('BV') + 1] if 'BV' in parts[:-1] else os.path.dirname(benchmark)
+
+def stable_key(benchmark, seed):
+    return hashlib.md5(f'{seed}:{benchmark}'.encode()).hexdigest()
+
+def stratified_sample(results, configs, size, seed):
+    # strata are benchmark families split by whether any configuration
+    # solved the benchmark, every stratum gets a proportional share
+    # (at least one benchmark)
+    strata = defaultdict(list)
+    for benchmark, res in results.items():
+        solved = any(is_solved(res[c]) for c in configs)
+        strata[(family(benchmark), solved)].append(benchmark)
+
+    total = len(results)
+    sample = []
+    for key in sorted(strata):
+        members = sorted(strata[key], key=lambda b: stable_key(b, seed))
+        share = max(1, round(size * len(members) / total))
+        sample += members[:share]
+    return sorted(sample)
+
+def binomial_tail(k, n):
+    # P[X >= k] for X ~ Bin(n, 1/2)
+    return sum(math.comb(n, i) for i in range(k, n + 1)) / 2 ** n
+
+def check_solved(column, sample, base, new, alpha):
+    lost = [b for b in sample if is_solved(base[b][column]) and not is_solved(new[b][column])]
+    gained = [b for b in sample if not is_solved(base[b][column]) and is_solved(new[b][column])]
+    base_cnt = sum(is_solved(base[b][column]) for b in sample)
+    new_cnt = sum(is_solved(new[b][column]) for b in sample)
+
+    # exact McNemar test on the benchmarks where the two runs differ
+    p = binomial_tail(len(lost), len(lost) + len(gained)) if lost else 1.0
+    failed = len(lost) > len(gained) and p < alpha
+    print(f'{column}: solved {base_cnt} -> {new_cnt}, lost {len(lost)}, gained {len(gained)}, p = {p:.4f}' + ('  REGRESSION' if failed else ''))
+    for b in lost:
+        print(f'    lost {b}')
+    return failed
+
+def check_durations(column, sample, base, new, base_durs, new_durs, alpha, threshold):
+    both = [b for b in sample if is_solved(base[b][column]) and is_solved(new[b][column])
+            and b in base_durs and b in new_durs]
+    if not both:
+        return False
+    ratios = [max(int(new_durs[b][column]), 1) / max(int(base_durs[b][column]), 1) for b in both]
+    geomean = math.exp(sum(math.log(r) for r in ratios) / len(ratios))
+
+    # sign test on the benchmarks that got noticeably slower or faster
+    slower = sum(r > 1 + threshold for r in ratios)
+    faster = sum(r < 1 / (1 + threshold) for r in ratios)
+    p = binomial_tail(slower, slower + faster) if slower else 1.0
+    failed = geomean > 1 + threshold and p < alpha
+    print(f'{column}: {len(both)} solved by both, duration ratio geomean {geomean:.3f} median {median(ratios):.3f}, '
+          f'slower {slower}, faster {faster}, p = {p:.4f}' + ('  REGRESSION' if failed else ''))
+    return failed
+
+def main():
+    parser = argparse.ArgumentParser(description='Checks the current build for performance regressions against stored results.')
+    parser.add_argument('baseline', help='stored results CSV, e.g. results_60s_complete.csv')
+    parser.add_argument('--baseline-durations', help='durations CSV written by fbs_runner for the baseline')
+    parser.add_argument('--results', help='results CSV of the current build, fbs_runner is run if missing')
+    parser.add_argument('--durations', help='durations CSV of the current build')
+    parser.add_argument('--timeout', type=int, default=60, help='time limit of the checked configurations')
+    parser.add_argument('--sample', type=int, default=100, help='number of benchmarks to replay')
+    parser.add_argument('--seed', type=int, default=1, help='seed of the sample selection')
+    parser.add_argument('--jobs', type=int, default=os.cpu_count() // 2 or 1, help='jobs for fbs_runner')
+    parser.add_argument('--alpha', type=float, default=0.05, help='significance level of the tests')
+    parser.add_argument('--threshold', type=float, default=10, help='allowed slowdown in percent')
+    args = parser.parse_args()
+
+    columns, base = load_csv(args.baseline)
+    configs = [c for c in columns if parse_config(c) and sum(parse_config(c)[::2]) == args.timeout]
+    if not configs:
+        print(f'No myapp_X+tool_Y configurations with timeout {args.timeout} in {args.baseline}')
+        sys.exit(1)
+    sample = stratified_sample(base, configs, args.sample, args.seed)
+
+    if args.results is None:
+        with open('regression_sample.txt', 'w') as file:
+            file.write('\n'.join(sample) + '\n')
+        splits = sorted({parse_config(c)[0] for c in configs})
+        tools = sorted({parse_config(c)[1] for c in configs})
+        for f in ['regression_results.csv', 'regression_durations.csv']:
+            if os.path.exists(f):
+                os.remove(f)
+        # the same CPU regime as compare.sh, which produced the stored results
+        cmd = [RUNNER_CMD, f'--jobs:{args.jobs}', '--pin:1', f'--timeout:{args.timeout}', '--baseline:0',
+               '--output:regression_results.csv', '--durations:regression_durations.csv']
+        cmd += [f'--split:{s}' for s in splits] + [f'--secondary:{t}' for t in tools]
+        cmd += [f'--tool:{t}={TOOL_COMMANDS[t]}' for t in tools]
+        subprocess.run(cmd + ['regression_sample.txt'], check=True)
+        args.results, args.durations = 'regression_results.csv', 'regression_durations.csv'
+
+    _, new = load_csv(args.results)
+    missing = [b for b in sample if b not in new]
+    if missing:
+        print(f'{len(missing)} sampled benchmarks are missing in {args.results}')
+        sys.exit(1)
+
+    base_durs = load_csv(args.baseline_durations)[1] if args.baseline_durations else {}
+    new_durs = load_csv(args.durations)[1] if args.durations else {}
+
+    print(f'Replayed {len(sample)} benchmarks')
+    failed = False
+    for column in configs:
+        failed |= check_solved(column, sample, base, new, args.alpha)
+    if base_durs and new_durs:
+        for column in configs:
+            failed |= check_durations(column, sample, base, new, base_durs, new_durs, args.alpha, args.threshold / 100)
+    else:
+        print('No baseline durations, only solved counts were checked')
+
+    if failed:
+        print('PERFORMANCE REGRESSION DETECTED')
+        sys.exit(1)
+    print('No regression')
+
+if __name__ == "__main__":
+    main()
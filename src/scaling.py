@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+
+# Runs FBS over a grid of formulas from fbs_gen and records wall time, peak
+# memory and the number of launched simplifier threads for every point.
+
+import os
+import sys
+import json
+import time
+import itertools
+import tempfile
+import subprocess
+
+FBS_CMD = os.path.realpath('../build/fbs')
+GEN_CMD = os.path.realpath('../build/fbs_gen')
+RESULTS_FILE = 'scaling.csv'
+
+# every combination of these values is generated, parameters not listed
+# keep the fbs_gen defaults
+GRID = {
+    'quants': [1, 2, 4, 8, 16],
+    'depth': [1, 2, 3],
+    'quantifier': ['alt', 'forall', 'exists'],
+    'width': [8, 16, 32],
+    'sharing': [0, 50],
+    'arith': [20, 80],
+}
+SEEDS = [1, 2, 3]
+
+def run_fbs(formula_file, stats_file, timeout):
+    start = time.monotonic()
+    proc = subprocess.Popen([FBS_CMD, f'--timeout:{timeout}', f'--stats:{stats_file}', formula_file],
+                            cwd=os.path.dirname(formula_file), stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    status = None
+    while status is None:
+        pid, wait_status, rusage = os.wait4(proc.pid, os.WNOHANG)
+        if pid != 0:
+            status = os.waitstatus_to_exitcode(wait_status)
+        elif time.monotonic() - start > timeout + 5:
+            proc.kill()
+            _, wait_status, rusage = os.wait4(proc.pid, 0)
+            status = 'timeout'
+        else:
+            time.sleep(0.01)
+    # the process was already reaped by wait4
+    proc.returncode = status if isinstance(status, int) else -9
+    return status, time.monotonic() - start, rusage.ru_maxrss
+
+def read_threads(stats_file):
+    try:
+        with open(stats_file) as file:
+            lines = [l for l in file if l.strip()]
+        return len(json.loads(lines[-1])['jobs'])
+    except (OSError, IndexError, KeyError, ValueError):
+        return -1
+
+def main():
+    if len(sys.argv) != 2:
+        print(f'Usage: {sys.argv[0]} <tmo for fbs>')
+        sys.exit(1)
+    timeout = int(sys.argv[1])
+
+    keys = list(GRID.keys())
+    with open(RESULTS_FILE, 'a') as results:
+        if results.tell() == 0:
+            results.write(', '.join(keys + ['seed', 'size', 'status', 'seconds', 'peak_rss_kb', 'threads']) + '\n')
+
+        for values in itertools.product(*GRID.values()):
+            for seed in SEEDS:
+                args = [f'--{k}:{v}' for k, v in zip(keys, values)] + [f'--seed:{seed}']
+                with tempfile.TemporaryDirectory() as work_dir:
+                    formula_file = os.path.join(work_dir, 'in.smt2')
+                    stats_file = os.path.join(work_dir, 'stats.jsonl')
+                    with open(formula_file, 'w') as file:
+                        subprocess.run([GEN_CMD] + args, stdout=file, check=True)
+
+                    status, seconds, rss = run_fbs(formula_file, stats_file, timeout)
+                    threads = read_threads(stats_file)
+                    size = os.path.getsize(formula_file)
+
+                line = ', '.join(str(v) for v in list(values) + [seed, size, status, f'{seconds:.3f}', rss, threads])
+                print(line)
+                results.write(line + '\n')
+                results.flush()
+
+if __name__ == "__main__":
+    main()